@@ -0,0 +1,306 @@
+//
+//  BasicLogger.h
+//  rwlogger
+//
+//  Created by Tayfun Ateş on 8.02.2019.
+//  Copyright © 2019 Tayfun Ateş. All rights reserved.
+//
+
+#ifndef BasicLogger_h
+#define BasicLogger_h
+
+#include "LoggerDetail.h"
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+namespace rw
+{
+    //Lock policies, BasicLogger only needs lock and unlock
+    
+    /**
+     * @brief    Lock which does nothing, for loggers used by a single thread.
+     */
+    struct NullLock
+    {
+        void lock() {}
+        void unlock() {}
+    };
+    
+    /**
+     * @brief    Busy waiting lock for loggers with short and rarely contended writes.
+     */
+    class SpinLock
+    {
+    public:
+        SpinLock() { m_flag.clear(); }
+        
+        void lock()
+        {
+            while(m_flag.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+        
+        void unlock() { m_flag.clear(std::memory_order_release); }
+    
+    private:
+        SpinLock(const SpinLock&);
+        SpinLock& operator=(const SpinLock&);
+        
+        std::atomic_flag m_flag;
+    };
+    
+    //Sink policies, called with the lock held
+    
+    /**
+     * @brief    Appends records to a file which is kept open. The size is tracked instead of queried for every record.
+     */
+    class FileSink
+    {
+    public:
+        explicit FileSink(const std::string& path) : m_path(path), m_pFile(nullptr), m_size(0) {}
+        
+        ~FileSink() { close(); }
+        
+        void write(const Logger::Level& /*level*/, const char* data, size_t len)
+        {
+            if(!m_pFile && !open()) {
+                return;
+            }
+            m_size += fwrite(data, 1, len, m_pFile);
+            fflush(m_pFile);
+        }
+        
+        size_t size()
+        {
+            if(!m_pFile) open();
+            return m_size;
+        }
+        
+        void truncate(size_t newLen)
+        {
+            if(newLen < RW_MIN_LOG_LENGTH) {
+                newLen = RW_MIN_LOG_LENGTH;
+            }
+            close();
+            detail::truncateFile(m_path, newLen);
+        }
+        
+        void rotate()
+        {
+            close();
+            const std::string newFileName = detail::getRotatedFilePath(m_path);
+            ::rename(m_path.c_str(), newFileName.c_str());
+        }
+        
+        const std::string& getPath() const { return m_path; }
+    
+    private:
+        FileSink(const FileSink&);
+        FileSink& operator=(const FileSink&);
+        
+        bool open()
+        {
+            m_pFile = fopen(m_path.c_str(), "ab");
+            if(!m_pFile) {
+                return false;
+            }
+            fseek(m_pFile, 0, SEEK_END);
+            const long pos = ftell(m_pFile);
+            m_size = pos > 0 ? size_t(pos) : 0;
+            return true;
+        }
+        
+        void close()
+        {
+            if(m_pFile)
+            {
+                fclose(m_pFile);
+                m_pFile = nullptr;
+            }
+        }
+        
+        std::string m_path;
+        FILE* m_pFile;
+        size_t m_size;
+    };
+    
+    /**
+     * @brief    Writes errors to the standard error and everything else to the standard output.
+     */
+    struct ConsoleSink
+    {
+        void write(const Logger::Level& level, const char* data, size_t len)
+        {
+            std::ostream &ostr = (level == Logger::LOG_LEVEL_ERROR) ? std::cerr : std::cout;
+            ostr.write(data, len);
+            ostr.flush();
+        }
+        
+        size_t size() { return 0; }
+        void truncate(size_t) {}
+        void rotate() {}
+    };
+    
+    /**
+     * @brief    Discards every record.
+     */
+    struct NullSink
+    {
+        void write(const Logger::Level&, const char*, size_t) {}
+        size_t size() { return 0; }
+        void truncate(size_t) {}
+        void rotate() {}
+    };
+    
+    //Overflow policies, checked before each record is written
+    
+    struct NoOverflow
+    {
+        template<class Sink>
+        static void check(Sink&, size_t) {}
+    };
+    
+    /**
+     * @brief    Truncates the sink to the half of the maximum log size, same as Logger::ACTION_TRUNCATE.
+     */
+    struct TruncateOverflow
+    {
+        template<class Sink>
+        static void check(Sink& sink, size_t maxLogSize)
+        {
+            if(sink.size() > maxLogSize) sink.truncate(maxLogSize/2);
+        }
+    };
+    
+    /**
+     * @brief    Moves the sink aside to a time stamped file, same as Logger::ACTION_ROTATE.
+     */
+    struct RotateOverflow
+    {
+        template<class Sink>
+        static void check(Sink& sink, size_t maxLogSize)
+        {
+            if(sink.size() > maxLogSize) sink.rotate();
+        }
+    };
+    
+    //Format policies
+    
+    /**
+     * @brief    Record format of Logger: "<time> <thread id> <level> <message>\n".
+     */
+    struct DefaultFormat
+    {
+        static void format(std::string& record, const Logger::Level& level, const char* message, size_t len)
+        {
+            record = detail::formatRecordHeader(level);
+            record.append(message, len).push_back('\n');
+        }
+    };
+    
+    /**
+     * @brief    Logger whose locking, destination, overflow handling and record format are chosen at compile time.
+     *           Nothing on the write path is virtual or decided at runtime, so it inlines into the calling code.
+     *           Records, size limits, rotated file names and truncation come from LoggerDetail.h, which Logger uses too,
+     *           so both write the same files.
+     */
+    template<class LockPolicy, class SinkPolicy, class OverflowPolicy = NoOverflow, class FormatPolicy = DefaultFormat>
+    class BasicLogger
+    {
+    public:
+        typedef Logger::Level Level;
+        
+        /**
+         * @brief    Stream which writes one record when it is destroyed. Filtered statements do not format anything.
+         */
+        class logstream : public std::ostringstream
+        {
+        public:
+            logstream(BasicLogger& oLogger, const Level& level) : m_logger(oLogger), m_logLevel(level), m_active(oLogger.isLogged(level))
+            {
+                if(!m_active) setstate(std::ios_base::badbit);
+            }
+            
+            logstream(const logstream& ls) : m_logger(ls.m_logger), m_logLevel(ls.m_logLevel), m_active(ls.m_active)
+            {
+                if(!m_active) setstate(std::ios_base::badbit);
+            }
+            
+            ~logstream()
+            {
+                if(m_active) m_logger.log(m_logLevel, str());
+            }
+        
+        private:
+            BasicLogger& m_logger;
+            const Level m_logLevel;
+            const bool m_active;
+        };
+        
+        BasicLogger() : m_logLevel(Logger::LOG_LEVEL_NORMAL), m_maxLogSize(RW_DEFAULT_MAX_LOG_LENGTH) {}
+        
+        /**
+         * @brief    Constructs the logger with a sink which needs an argument, e.g. the path of a FileSink.
+         */
+        template<class Arg>
+        explicit BasicLogger(const Arg& sinkArg) : m_sink(sinkArg), m_logLevel(Logger::LOG_LEVEL_NORMAL), m_maxLogSize(RW_DEFAULT_MAX_LOG_LENGTH) {}
+        
+        void setLogLevel(const Level& level) { m_logLevel.store(level, std::memory_order_relaxed); }
+        Level getLogLevel() const { return m_logLevel.load(std::memory_order_relaxed); }
+        
+        /**
+         * @brief    Sets the size which triggers the overflow policy. Sizes below RW_MIN_LOG_LENGTH are raised to it, as in Logger.
+         * @param    maxLogSize                  Maximum log size in bytes
+         */
+        void setMaxLogSize(size_t maxLogSize) { m_maxLogSize = maxLogSize > RW_MIN_LOG_LENGTH ? maxLogSize : RW_MIN_LOG_LENGTH; }
+        size_t getMaxLogSize() const { return m_maxLogSize; }
+        
+        bool isLogged(const Level& level) const { return level <= m_logLevel.load(std::memory_order_relaxed); }
+        
+        /**
+         * @brief    Writes a record if level is enabled.
+         * @param    level                       Level of the record
+         * @param    message                     Message of the record without the trailing new line
+         */
+        void log(const Level& level, const std::string& message)
+        {
+            if(!isLogged(level)) {
+                return;
+            }
+            std::string record;
+            FormatPolicy::format(record, level, message.data(), message.size());
+            
+            m_lock.lock();
+            OverflowPolicy::check(m_sink, m_maxLogSize);
+            m_sink.write(level, record.data(), record.size());
+            m_lock.unlock();
+        }
+        
+        logstream operator()(const Level& level) { return logstream(*this, level); }
+        
+        SinkPolicy& getSink() { return m_sink; }
+    
+    private:
+        BasicLogger(const BasicLogger&);
+        BasicLogger& operator=(const BasicLogger&);
+        
+        LockPolicy m_lock;
+        SinkPolicy m_sink;
+        std::atomic<Level> m_logLevel;
+        size_t m_maxLogSize;
+    };
+    
+    typedef BasicLogger<NullLock, FileSink, TruncateOverflow> SingleThreadedFileLogger;
+    typedef BasicLogger<NullLock, FileSink, RotateOverflow> SingleThreadedRotatingFileLogger;
+    typedef BasicLogger<NullLock, ConsoleSink> SingleThreadedConsoleLogger;
+    typedef BasicLogger<SpinLock, FileSink, TruncateOverflow> SpinLockFileLogger;
+    typedef BasicLogger<std::mutex, FileSink, TruncateOverflow> MutexFileLogger;
+}
+
+#endif /* BasicLogger_h */
@@ -0,0 +1,304 @@
+//
+//  LogReader.cpp
+//  rwlogger
+//
+//  Created by Tayfun Ateş on 8.02.2019.
+//  Copyright © 2019 Tayfun Ateş. All rights reserved.
+//
+
+#include "LogReader.h"
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define RW_READER_HEADER_SIZE       48      // "[time] threadid LVL| "
+#define RW_READER_LEVEL_OFFSET      43
+
+namespace rw
+{
+    LogReader::LogReader(const std::string& filePath, bool fromStart)
+    {
+        m_path = filePath;
+        m_fd = -1;
+        m_device = 0;
+        m_inode = 0;
+        m_offset = 0;
+        m_fromStart = fromStart;
+        
+        openFile();
+    }
+    
+    LogReader::~LogReader()
+    {
+        releaseWindows();
+        closeFile();
+    }
+    
+    size_t LogReader::parseRecords(const char* pData, size_t size, std::vector<Record>& records)
+    {
+        const char* p = pData;
+        const char* const pEnd = pData + size;
+        while(p < pEnd)
+        {
+            const char* pNewLine = static_cast<const char*>(memchr(p, '\n', pEnd - p));
+            if(!pNewLine) {
+                break; //Incomplete line, returned when its end is written
+            }
+            
+            Record record;
+            record.data = p;
+            record.size = pNewLine - p;
+            if(record.size > 0 && p[record.size - 1] == '\r') {
+                record.size--;
+            }
+            record.message = record.data;
+            record.messageSize = record.size;
+            record.level = Logger::LOG_LEVEL_NORMAL;
+            
+            if(record.size >= RW_READER_HEADER_SIZE && p[0] == '[' && p[RW_READER_HEADER_SIZE - 2] == '|')
+            {
+                const char* pLevel = p + RW_READER_LEVEL_OFFSET;
+                if(memcmp(pLevel, "ERR", 3) == 0) record.level = Logger::LOG_LEVEL_ERROR;
+                else if(memcmp(pLevel, "WRN", 3) == 0) record.level = Logger::LOG_LEVEL_WARNING;
+                else if(memcmp(pLevel, "DBG", 3) == 0) record.level = Logger::LOG_LEVEL_DEBUG;
+                record.message = p + RW_READER_HEADER_SIZE;
+                record.messageSize = record.size - RW_READER_HEADER_SIZE;
+            }
+            
+            records.push_back(record);
+            p = pNewLine + 1;
+        }
+        return p - pData;
+    }
+    
+    void LogReader::releaseWindows()
+    {
+#ifndef _MSC_VER
+        for(size_t i=0; i < m_windows.size(); i++) {
+            if(m_windows[i].pMap) munmap(m_windows[i].pMap, m_windows[i].mapSize);
+        }
+#endif
+        m_windows.clear();
+    }
+    
+    size_t LogReader::wait(std::vector<Record>& records, unsigned timeoutMs)
+    {
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        
+        //Registered before polling, so a record written after the poll is notified
+        Logger::m_writeWaiters++;
+        size_t count = 0;
+        while(true)
+        {
+            unsigned long long sequence;
+            {
+                std::lock_guard<std::mutex> lk(Logger::m_writeNotifyMutex);
+                sequence = Logger::m_writeSequence;
+            }
+            
+            count = poll(records);
+            if(count > 0 || std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+            
+            //Any logger of the process wakes the readers up, the file is checked again to see if it was this one
+            std::unique_lock<std::mutex> lk(Logger::m_writeNotifyMutex);
+            Logger::m_writeNotifyCond.wait_until(lk, deadline, [sequence]() { return Logger::m_writeSequence != sequence; });
+        }
+        Logger::m_writeWaiters--;
+        return count;
+    }
+
+#ifndef _MSC_VER
+    bool LogReader::openFile()
+    {
+        m_fd = ::open(m_path.c_str(), O_RDONLY);
+        if(m_fd < 0) {
+            return false;
+        }
+        
+        struct stat st;
+        fstat(m_fd, &st);
+        m_device = static_cast<unsigned long long>(st.st_dev);
+        m_inode = static_cast<unsigned long long>(st.st_ino);
+        m_offset = m_fromStart ? 0 : static_cast<size_t>(st.st_size);
+        
+        //Files appearing later are read from their start
+        m_fromStart = true;
+        return true;
+    }
+    
+    void LogReader::closeFile()
+    {
+        if(m_fd >= 0)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+    
+    const char* LogReader::readRange(int fd, size_t from, size_t to)
+    {
+        static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t mapStart = from - from % pageSize;
+        
+        Window window;
+        window.mapSize = to - mapStart;
+        window.pMap = mmap(nullptr, window.mapSize, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(mapStart));
+        if(window.pMap == MAP_FAILED) {
+            return nullptr;
+        }
+        m_windows.push_back(window);
+        return static_cast<const char*>(window.pMap) + (from - mapStart);
+    }
+    
+    size_t LogReader::poll(std::vector<Record>& records)
+    {
+        releaseWindows();
+        const size_t count = records.size();
+        
+        if(m_fd < 0 && !openFile()) {
+            return 0;
+        }
+        
+        //A different file at the path means the file was rotated (the old one is renamed) or truncated (the old one is removed)
+        struct stat pathStat;
+        const bool replaced = stat(m_path.c_str(), &pathStat) == 0 &&
+            (static_cast<unsigned long long>(pathStat.st_dev) != m_device || static_cast<unsigned long long>(pathStat.st_ino) != m_inode);
+        
+        struct stat fileStat;
+        if(fstat(m_fd, &fileStat) != 0) {
+            return 0;
+        }
+        size_t size = static_cast<size_t>(fileStat.st_size);
+        if(size < m_offset) {
+            m_offset = 0; //Truncated in place
+        }
+        
+        //New bytes of the current file, or the rest of the old file before following the new one
+        if(size > m_offset)
+        {
+            const char* pData = readRange(m_fd, m_offset, size);
+            if(pData) {
+                m_offset += parseRecords(pData, size - m_offset, records);
+            }
+        }
+        
+        if(replaced)
+        {
+            const int oldFd = m_fd;
+            const size_t oldEnd = m_offset;
+            const bool truncated = fileStat.st_nlink == 0;
+            m_fd = -1;
+            
+            if(openFile())
+            {
+                m_offset = 0;
+                struct stat newStat;
+                fstat(m_fd, &newStat);
+                size = static_cast<size_t>(newStat.st_size);
+                
+                //Truncation copies the end of the old file into the new one, those lines are already returned.
+                //The copy ends with the last line of the old file and is a suffix of it.
+                if(truncated && oldEnd > 0 && size > 0)
+                {
+                    const size_t tailSize = std::min(oldEnd, size);
+                    const char* pOld = readRange(oldFd, oldEnd - tailSize, oldEnd);
+                    const char* pNew = readRange(m_fd, 0, size);
+                    if(pOld && pNew)
+                    {
+                        const char* pOldEnd = pOld + tailSize;
+                        const char* pLastLine = pOldEnd - 1;
+                        while(pLastLine > pOld && pLastLine[-1] != '\n') {
+                            pLastLine--;
+                        }
+                        const char* p = pNew;
+                        const char* const pNewEnd = pNew + size;
+                        while((p = std::search(p, pNewEnd, pLastLine, pOldEnd)) != pNewEnd)
+                        {
+                            const size_t carried = (p - pNew) + (pOldEnd - pLastLine);
+                            if(carried <= tailSize && memcmp(pNew, pOldEnd - carried, carried) == 0)
+                            {
+                                m_offset = carried;
+                                break;
+                            }
+                            p++;
+                        }
+                    }
+                }
+                
+                if(size > m_offset)
+                {
+                    const char* pData = readRange(m_fd, m_offset, size);
+                    if(pData) {
+                        m_offset += parseRecords(pData, size - m_offset, records);
+                    }
+                }
+            }
+            ::close(oldFd);
+        }
+        
+        return records.size() - count;
+    }
+#else
+    //Windows cannot rename or remove a file which is open, the file is opened only while reading
+    bool LogReader::openFile()
+    {
+        std::ifstream inFile(m_path.c_str(), std::ios::in | std::ios::binary);
+        if(!inFile.is_open()) {
+            return false;
+        }
+        inFile.seekg(0, std::ios::end);
+        m_offset = m_fromStart ? 0 : static_cast<size_t>(inFile.tellg());
+        m_fromStart = true;
+        return true;
+    }
+    
+    void LogReader::closeFile()
+    {
+    }
+    
+    const char* LogReader::readRange(int, size_t, size_t)
+    {
+        return nullptr;
+    }
+    
+    size_t LogReader::poll(std::vector<Record>& records)
+    {
+        releaseWindows();
+        const size_t count = records.size();
+        
+        std::ifstream inFile(m_path.c_str(), std::ios::in | std::ios::binary);
+        if(!inFile.is_open()) {
+            return 0;
+        }
+        inFile.seekg(0, std::ios::end);
+        const size_t size = static_cast<size_t>(inFile.tellg());
+        if(size < m_offset) {
+            m_offset = 0; //Rotated or truncated
+        }
+        
+        if(size > m_offset)
+        {
+            Window window;
+            window.pMap = nullptr;
+            window.mapSize = 0;
+            m_windows.push_back(window);
+            std::vector<char>& buffer = m_windows.back().buffer;
+            buffer.resize(size - m_offset);
+            inFile.seekg(m_offset, std::ios::beg);
+            inFile.read(&buffer[0], buffer.size());
+            m_offset += parseRecords(&buffer[0], static_cast<size_t>(inFile.gcount()), records);
+        }
+        
+        return records.size() - count;
+    }
+#endif
+}
@@ -0,0 +1,110 @@
+//
+//  LogReader.h
+//  rwlogger
+//
+//  Created by Tayfun Ateş on 8.02.2019.
+//  Copyright © 2019 Tayfun Ateş. All rights reserved.
+//
+
+#ifndef LogReader_h
+#define LogReader_h
+
+#include "Logger.h"
+#include <string>
+#include <vector>
+
+namespace rw
+{
+    /**
+     * @brief    Follows a log file like "tail -F" and returns the records appended since the previous call.
+     *           Only new bytes are read, they are mapped into memory and records point into the mapping instead of being copied.
+     *           Rotation and truncation of the file are followed: the rest of the previous file is read before the new one,
+     *           and the records which truncation carries over into the new file are not returned twice.
+     *           A reader is used by one thread. On Windows new bytes are read into a buffer and the file is not kept open,
+     *           rotation and truncation are detected by the file getting smaller.
+     *           Files must not be shrunk in place while records returned from them are used, Logger never does it.
+     */
+    class LogReader
+    {
+    public:
+        /**
+         * @brief    A complete line of the log file. Pointers are valid until the next poll or wait call.
+         */
+        struct Record
+        {
+            const char*     data;           ///< Start of the line, without the new line character
+            size_t          size;           ///< Length of the line
+            const char*     message;        ///< Start of the message, after the header. Equals data if the line has no header
+            size_t          messageSize;    ///< Length of the message
+            Logger::Level   level;          ///< Level parsed from the header, NORMAL for lines without a header (NORMAL and INSANE share the header)
+            
+            std::string getMessage() const { return std::string(message, messageSize); }
+        };
+        
+        /**
+         * @brief                       Creates a reader of filePath. The file does not have to exist yet.
+         * @param    filePath           Path to the log file.
+         * @param    fromStart          true to return the records already in the file, false to return only the records appended after construction.
+         */
+        explicit LogReader(const std::string& filePath, bool fromStart = false);
+        ~LogReader();
+        
+        /**
+         * @brief                       Appends the complete records written since the previous call to records. Does not block.
+         *                              Records of the previous call become invalid.
+         * @param    records            Vector to which records are appended.
+         * @return                      Number of appended records.
+         */
+        size_t poll(std::vector<Record>& records);
+        
+        /**
+         * @brief                       Same as poll, but waits up to timeoutMs if there are no new records.
+         *                              Wakes up when a logger of this process writes a record. Files written by other processes are checked when the wait times out.
+         * @param    records            Vector to which records are appended.
+         * @param    timeoutMs          Maximum time to wait in milliseconds.
+         * @return                      Number of appended records, 0 if the wait timed out.
+         */
+        size_t wait(std::vector<Record>& records, unsigned timeoutMs);
+        
+        const std::string& getPath() const { return m_path; }
+    
+    private:
+        LogReader(const LogReader&);
+        LogReader& operator=(const LogReader&);
+        
+        //Bytes of a file made available to the caller until the next poll
+        struct Window
+        {
+            void*               pMap;       ///< Mapping, null if the bytes are in buffer
+            size_t              mapSize;
+            std::vector<char>   buffer;
+        };
+        
+        /**
+         * @brief                       Makes bytes [from, to) of fd available in a new window. Returns null if they cannot be read.
+         */
+        const char* readRange(int fd, size_t from, size_t to);
+        
+        /**
+         * @brief                       Appends complete lines of [pData, pData + size) to records and returns the number of bytes they take.
+         */
+        static size_t parseRecords(const char* pData, size_t size, std::vector<Record>& records);
+        
+        /**
+         * @brief                       Opens the file at m_path if it exists. m_offset is set to its end for the first file of a reader not reading from the start, to 0 otherwise.
+         */
+        bool openFile();
+        void closeFile();
+        void releaseWindows();
+        
+        std::string             m_path;         ///< Path to the followed file
+        int                     m_fd;           ///< Descriptor of the followed file, -1 if it is not open
+        unsigned long long      m_device;       ///< Device and inode of m_fd, a different pair at m_path means it is rotated or truncated
+        unsigned long long      m_inode;
+        size_t                  m_offset;       ///< Position of the first byte not returned yet, always at the start of a line
+        std::vector<Window>     m_windows;      ///< Windows of the records returned by the last call
+        bool                    m_fromStart;    ///< Read the file from its start when it is opened for the first time
+    };
+}
+
+#endif /* LogReader_h */
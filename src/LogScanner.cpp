@@ -0,0 +1,524 @@
+//
+//  LogScanner.cpp
+//  rwlogger
+//
+//  Created by Tayfun Ateş on 8.02.2019.
+//  Copyright © 2019 Tayfun Ateş. All rights reserved.
+//
+
+#include "LogScanner.h"
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RW_SCAN_X86
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#define RW_TARGET_AVX2
+#else
+#define RW_TARGET_AVX2              __attribute__((target("avx2")))
+#endif
+
+#define RW_SCAN_HEADER_SIZE         48                  // "[time] threadid LVL| "
+#define RW_SCAN_TIME_OFFSET         1
+#define RW_SCAN_TIME_SIZE           23
+#define RW_SCAN_THREAD_OFFSET       26
+#define RW_SCAN_THREAD_SIZE         16
+#define RW_SCAN_LEVEL_OFFSET        43
+#define RW_SCAN_CHUNK_SIZE          (4*1024*1024)       // Unit of work of a scanning thread
+#define RW_SCAN_CHUNKS_PER_THREAD   4                   // Chunks a thread may scan ahead of the reported ones
+
+namespace rw
+{
+    //Search kernels, return the first occurrence of needle in [p, pEnd) or pEnd
+    
+    typedef const char* (*FindFunction)(const char* p, const char* pEnd, const char* needle, size_t needleSize);
+    
+    static const char* findScalar(const char* p, const char* pEnd, const char* needle, size_t needleSize)
+    {
+        if(needleSize == 0) {
+            return p;
+        }
+        while(static_cast<size_t>(pEnd - p) >= needleSize)
+        {
+            p = static_cast<const char*>(memchr(p, needle[0], (pEnd - p) - needleSize + 1));
+            if(!p) {
+                return pEnd;
+            }
+            if(memcmp(p + 1, needle + 1, needleSize - 1) == 0) {
+                return p;
+            }
+            p++;
+        }
+        return pEnd;
+    }
+
+#ifdef RW_SCAN_X86
+    static inline unsigned countTrailingZeros(unsigned mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+    
+    //Blocks whose first byte matches the first byte of needle and whose last byte matches the last byte of needle are compared
+    static const char* findSSE2(const char* p, const char* pEnd, const char* needle, size_t needleSize)
+    {
+        if(needleSize == 0 || static_cast<size_t>(pEnd - p) < needleSize) {
+            return needleSize == 0 ? p : pEnd;
+        }
+        const __m128i first = _mm_set1_epi8(needle[0]);
+        const __m128i last = _mm_set1_epi8(needle[needleSize - 1]);
+        const char* const pLastStart = pEnd - needleSize;
+        while(pLastStart - p >= 15)
+        {
+            const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + needleSize - 1));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last))));
+            while(mask)
+            {
+                const unsigned bit = countTrailingZeros(mask);
+                if(needleSize <= 2 || memcmp(p + bit + 1, needle + 1, needleSize - 2) == 0) {
+                    return p + bit;
+                }
+                mask &= mask - 1;
+            }
+            p += 16;
+        }
+        return findScalar(p, pEnd, needle, needleSize);
+    }
+    
+    RW_TARGET_AVX2
+    static const char* findAVX2(const char* p, const char* pEnd, const char* needle, size_t needleSize)
+    {
+        if(needleSize == 0 || static_cast<size_t>(pEnd - p) < needleSize) {
+            return needleSize == 0 ? p : pEnd;
+        }
+        const __m256i first = _mm256_set1_epi8(needle[0]);
+        const __m256i last = _mm256_set1_epi8(needle[needleSize - 1]);
+        const char* const pLastStart = pEnd - needleSize;
+        while(pLastStart - p >= 31)
+        {
+            const __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            const __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + needleSize - 1));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last))));
+            while(mask)
+            {
+                const unsigned bit = countTrailingZeros(mask);
+                if(needleSize <= 2 || memcmp(p + bit + 1, needle + 1, needleSize - 2) == 0) {
+                    return p + bit;
+                }
+                mask &= mask - 1;
+            }
+            p += 32;
+        }
+        return findSSE2(p, pEnd, needle, needleSize);
+    }
+#endif
+    
+    static bool isKernelSupported(LogScanner::Kernel kernel)
+    {
+        if(kernel == LogScanner::KERNEL_SCALAR) {
+            return true;
+        }
+#ifdef RW_SCAN_X86
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        if(kernel == LogScanner::KERNEL_SSE2) {
+            return (info[3] & (1 << 26)) != 0;
+        }
+        //AVX2 needs the OS to save the YMM registers
+        const bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        return kernel == LogScanner::KERNEL_AVX2 && osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        if(kernel == LogScanner::KERNEL_SSE2) {
+            return __builtin_cpu_supports("sse2");
+        }
+        return kernel == LogScanner::KERNEL_AVX2 && __builtin_cpu_supports("avx2");
+#endif
+#else
+        return false;
+#endif
+    }
+    
+    static FindFunction getFindFunction(LogScanner::Kernel kernel)
+    {
+#ifdef RW_SCAN_X86
+        if(kernel == LogScanner::KERNEL_AVX2) return findAVX2;
+        if(kernel == LogScanner::KERNEL_SSE2) return findSSE2;
+#endif
+        return findScalar;
+    }
+    
+    static LogScanner::Kernel getBestKernel()
+    {
+        if(isKernelSupported(LogScanner::KERNEL_AVX2)) return LogScanner::KERNEL_AVX2;
+        if(isKernelSupported(LogScanner::KERNEL_SSE2)) return LogScanner::KERNEL_SSE2;
+        return LogScanner::KERNEL_SCALAR;
+    }
+    
+    static LogScanner::Kernel s_kernel = getBestKernel();
+    static FindFunction s_find = getFindFunction(s_kernel);
+    
+    bool LogScanner::setKernel(Kernel kernel)
+    {
+        if(kernel == KERNEL_AUTO) {
+            kernel = getBestKernel();
+        }
+        if(!isKernelSupported(kernel)) {
+            return false;
+        }
+        s_kernel = kernel;
+        s_find = getFindFunction(kernel);
+        return true;
+    }
+    
+    LogScanner::Kernel LogScanner::getKernel()
+    {
+        return s_kernel;
+    }
+    
+    const char* LogScanner::getKernelName(Kernel kernel)
+    {
+        switch(kernel)
+        {
+            case KERNEL_SCALAR: return "scalar";
+            case KERNEL_SSE2: return "sse2";
+            case KERNEL_AVX2: return "avx2";
+            default: return "auto";
+        }
+    }
+    
+    //Record matching
+    
+    typedef std::vector<std::pair<const char*, size_t> > MatchList;
+    
+    /**
+     * @brief    Filter prepared for a scan. The anchor is the part of the filter searched in the buffer,
+     *           at a fixed offset in the line or anywhere in the message if anchorOffset is npos.
+     */
+    struct ScanPlan
+    {
+        const LogScanner::Filter*   pFilter;
+        bool                        needsHeader;
+        std::string                 anchor;
+        size_t                      anchorOffset;
+    };
+    
+    static bool hasHeader(const char* line, size_t size)
+    {
+        return size >= RW_SCAN_HEADER_SIZE && line[0] == '[' && line[RW_SCAN_TIME_OFFSET + RW_SCAN_TIME_SIZE] == ']' &&
+            line[RW_SCAN_HEADER_SIZE - 2] == '|' && line[RW_SCAN_HEADER_SIZE - 1] == ' ';
+    }
+    
+    static unsigned getLevelBit(const char* tag)
+    {
+        if(memcmp(tag, "ERR", 3) == 0) return LogScanner::LEVEL_ERROR;
+        if(memcmp(tag, "WRN", 3) == 0) return LogScanner::LEVEL_WARNING;
+        if(memcmp(tag, "DBG", 3) == 0) return LogScanner::LEVEL_DEBUG;
+        return LogScanner::LEVEL_NORMAL;
+    }
+    
+    static bool matchLine(const char* line, size_t size, const ScanPlan& plan)
+    {
+        const LogScanner::Filter& filter = *plan.pFilter;
+        const char* pMessage = line;
+        if(hasHeader(line, size))
+        {
+            if(!(filter.levels & getLevelBit(line + RW_SCAN_LEVEL_OFFSET))) {
+                return false;
+            }
+            if(!filter.threadId.empty() && memcmp(line + RW_SCAN_THREAD_OFFSET, filter.threadId.data(), RW_SCAN_THREAD_SIZE) != 0) {
+                return false;
+            }
+            //Timestamps compare lexicographically
+            const char* pTime = line + RW_SCAN_TIME_OFFSET;
+            if(!filter.fromTime.empty() && memcmp(pTime, filter.fromTime.data(), std::min(filter.fromTime.size(), size_t(RW_SCAN_TIME_SIZE))) < 0) {
+                return false;
+            }
+            if(!filter.toTime.empty() && memcmp(pTime, filter.toTime.data(), std::min(filter.toTime.size(), size_t(RW_SCAN_TIME_SIZE))) > 0) {
+                return false;
+            }
+            pMessage = line + RW_SCAN_HEADER_SIZE;
+        }
+        else if(plan.needsHeader)
+        {
+            return false;
+        }
+        
+        const char* const pEnd = line + size;
+        return filter.substring.empty() || s_find(pMessage, pEnd, filter.substring.data(), filter.substring.size()) != pEnd;
+    }
+    
+    static void addLine(const char* line, const char* pEnd, const ScanPlan& plan, MatchList& matches)
+    {
+        size_t size = pEnd - line;
+        if(size > 0 && line[size - 1] == '\r') {
+            size--;
+        }
+        if(matchLine(line, size, plan)) {
+            matches.push_back(std::make_pair(line, size));
+        }
+    }
+    
+    static void scanChunk(const char* pBegin, const char* pEnd, const ScanPlan& plan, MatchList& matches)
+    {
+        const FindFunction find = s_find;
+        const char* p = pBegin;
+        
+        if(plan.anchor.empty())
+        {
+            while(p < pEnd)
+            {
+                const char* pLineEnd = find(p, pEnd, "\n", 1);
+                addLine(p, pLineEnd, plan, matches);
+                p = pLineEnd + 1;
+            }
+            return;
+        }
+        
+        //Only the lines containing the anchor are looked at
+        while(p < pEnd)
+        {
+            const char* pHit = find(p, pEnd, plan.anchor.data(), plan.anchor.size());
+            if(pHit == pEnd) {
+                break;
+            }
+            const char* pLine = pHit;
+            while(pLine > pBegin && pLine[-1] != '\n') {
+                pLine--;
+            }
+            if(plan.anchorOffset != std::string::npos && static_cast<size_t>(pHit - pLine) < plan.anchorOffset)
+            {
+                p = pHit + 1; //Too early in the line to be the anchor, the line may still match later
+                continue;
+            }
+            const char* pLineEnd = find(pHit, pEnd, "\n", 1);
+            if(plan.anchorOffset == std::string::npos || static_cast<size_t>(pHit - pLine) == plan.anchorOffset) {
+                addLine(pLine, pLineEnd, plan, matches);
+            }
+            p = pLineEnd + 1;
+        }
+    }
+    
+    static bool makePlan(const LogScanner::Filter& filter, ScanPlan& plan)
+    {
+        if((filter.levels & LogScanner::LEVEL_ALL) == 0) {
+            return false;
+        }
+        if(!filter.threadId.empty() && filter.threadId.size() != RW_SCAN_THREAD_SIZE) {
+            return false;
+        }
+        
+        plan.pFilter = &filter;
+        plan.needsHeader = (filter.levels & LogScanner::LEVEL_ALL) != LogScanner::LEVEL_ALL || !filter.threadId.empty() || !filter.fromTime.empty() || !filter.toTime.empty();
+        plan.anchorOffset = std::string::npos;
+        
+        //The most selective part of the filter is searched, a substring first, then a single level, then a thread
+        const unsigned levels = filter.levels & LogScanner::LEVEL_ALL;
+        if(!filter.substring.empty())
+        {
+            plan.anchor = filter.substring;
+        }
+        else if(levels == LogScanner::LEVEL_ERROR || levels == LogScanner::LEVEL_WARNING || levels == LogScanner::LEVEL_DEBUG || levels == LogScanner::LEVEL_NORMAL)
+        {
+            const char* tag = levels == LogScanner::LEVEL_ERROR ? "ERR| " : levels == LogScanner::LEVEL_WARNING ? "WRN| " : levels == LogScanner::LEVEL_DEBUG ? "DBG| " : "   | ";
+            plan.anchor = tag;
+            plan.anchorOffset = RW_SCAN_LEVEL_OFFSET;
+        }
+        else if(!filter.threadId.empty())
+        {
+            plan.anchor = " " + filter.threadId + " ";
+            plan.anchorOffset = RW_SCAN_THREAD_OFFSET - 1;
+        }
+        return true;
+    }
+    
+    size_t LogScanner::scanBuffer(const char* data, size_t size, const Filter& filter, const RecordHandler& handler, unsigned threadCount)
+    {
+        ScanPlan plan;
+        if(size == 0 || !makePlan(filter, plan)) {
+            return 0;
+        }
+        if(threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        
+        //Chunks start at line boundaries so that every line belongs to exactly one chunk
+        std::vector<const char*> bounds;
+        const char* const pEnd = data + size;
+        bounds.push_back(data);
+        for(size_t offset = RW_SCAN_CHUNK_SIZE; offset < size; offset += RW_SCAN_CHUNK_SIZE)
+        {
+            const char* pStart = data + offset;
+            if(pStart < bounds.back()) {
+                continue;
+            }
+            pStart = s_find(pStart - 1, pEnd, "\n", 1);
+            if(pStart == pEnd) {
+                break;
+            }
+            bounds.push_back(pStart + 1);
+        }
+        bounds.push_back(pEnd);
+        const size_t chunkCount = bounds.size() - 1;
+        
+        size_t matchCount = 0;
+        if(threadCount == 1 || chunkCount == 1)
+        {
+            MatchList matches;
+            for(size_t i=0; i < chunkCount; i++)
+            {
+                matches.clear();
+                scanChunk(bounds[i], bounds[i + 1], plan, matches);
+                for(size_t m=0; m < matches.size(); m++) {
+                    handler(matches[m].first, matches[m].second);
+                }
+                matchCount += matches.size();
+            }
+            return matchCount;
+        }
+        
+        //Workers scan chunks ahead, the calling thread reports them in order
+        std::vector<MatchList> results(chunkCount);
+        std::vector<char> done(chunkCount, 0);
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t nextChunk = 0;
+        size_t reported = 0;
+        const size_t window = size_t(threadCount) * RW_SCAN_CHUNKS_PER_THREAD;
+        
+        std::vector<std::thread> workers;
+        for(unsigned t=0; t < std::min<size_t>(threadCount, chunkCount); t++)
+        {
+            workers.push_back(std::thread([&]() {
+                while(true)
+                {
+                    size_t chunk;
+                    {
+                        std::unique_lock<std::mutex> lk(mutex);
+                        cond.wait(lk, [&]() { return nextChunk >= chunkCount || nextChunk < reported + window; });
+                        if(nextChunk >= chunkCount) {
+                            return;
+                        }
+                        chunk = nextChunk++;
+                    }
+                    MatchList matches;
+                    scanChunk(bounds[chunk], bounds[chunk + 1], plan, matches);
+                    {
+                        std::lock_guard<std::mutex> lk(mutex);
+                        results[chunk].swap(matches);
+                        done[chunk] = 1;
+                    }
+                    cond.notify_all();
+                }
+            }));
+        }
+        
+        for(size_t i=0; i < chunkCount; i++)
+        {
+            MatchList matches;
+            {
+                std::unique_lock<std::mutex> lk(mutex);
+                cond.wait(lk, [&]() { return done[i] != 0; });
+                matches.swap(results[i]);
+                reported = i + 1;
+            }
+            cond.notify_all();
+            for(size_t m=0; m < matches.size(); m++) {
+                handler(matches[m].first, matches[m].second);
+            }
+            matchCount += matches.size();
+        }
+        
+        for(size_t t=0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+        return matchCount;
+    }
+    
+    Logger::Result LogScanner::scanFile(const std::string& filePath, const Filter& filter, const RecordHandler& handler, size_t& matchCount, unsigned threadCount)
+    {
+        matchCount = 0;
+        ScanPlan plan;
+        if(!makePlan(filter, plan)) {
+            return Logger::RES_BAD_ARGS;
+        }
+
+#ifdef _MSC_VER
+        HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if(file == INVALID_HANDLE_VALUE) {
+            return Logger::RES_FILE_ERROR;
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        const size_t size = static_cast<size_t>(fileSize.QuadPart);
+        if(size == 0)
+        {
+            CloseHandle(file);
+            return Logger::RES_OK;
+        }
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        const void* pMap = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if(!pMap)
+        {
+            if(mapping) CloseHandle(mapping);
+            CloseHandle(file);
+            return Logger::RES_FILE_ERROR;
+        }
+        matchCount = scanBuffer(static_cast<const char*>(pMap), size, filter, handler, threadCount);
+        UnmapViewOfFile(pMap);
+        CloseHandle(mapping);
+        CloseHandle(file);
+#else
+        const int fd = ::open(filePath.c_str(), O_RDONLY);
+        if(fd < 0) {
+            return Logger::RES_FILE_ERROR;
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return Logger::RES_FILE_ERROR;
+        }
+        const size_t size = static_cast<size_t>(st.st_size);
+        if(size == 0)
+        {
+            ::close(fd);
+            return Logger::RES_OK;
+        }
+        void* pMap = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(pMap == MAP_FAILED) {
+            return Logger::RES_FILE_ERROR;
+        }
+        madvise(pMap, size, MADV_SEQUENTIAL);
+        matchCount = scanBuffer(static_cast<const char*>(pMap), size, filter, handler, threadCount);
+        munmap(pMap, size);
+#endif
+        return Logger::RES_OK;
+    }
+}
@@ -0,0 +1,104 @@
+//
+//  LogScanner.h
+//  rwlogger
+//
+//  Created by Tayfun Ateş on 8.02.2019.
+//  Copyright © 2019 Tayfun Ateş. All rights reserved.
+//
+
+#ifndef LogScanner_h
+#define LogScanner_h
+
+#include "Logger.h"
+#include <string>
+#include <functional>
+
+namespace rw
+{
+    /**
+     * @brief    Finds the records of rwlogger files which match a filter, for triage of large files.
+     *           Records are expected in the layout written by Logger: "[YYYY-MM-DD-HH-MM-SS-mmm] <16 hex thread id> <LVL>| <message>".
+     *           Files are memory mapped and split into chunks at line boundaries which are scanned in parallel, matches are reported in file order.
+     *           Instead of splitting every line, the most selective part of the filter (substring, level tag or thread id) is searched
+     *           with SSE2 or AVX2 kernels and only the lines around the hits are checked. Kernels are selected by the CPU at runtime.
+     */
+    class LogScanner
+    {
+    public:
+        enum Kernel
+        {
+            KERNEL_AUTO = 0,            ///< Best kernel supported by the CPU
+            KERNEL_SCALAR,              ///< memchr and memcmp, used on CPUs other than x86
+            KERNEL_SSE2,
+            KERNEL_AVX2
+        };
+        
+        enum LevelMask
+        {
+            LEVEL_ERROR     = 1,
+            LEVEL_WARNING   = 2,
+            LEVEL_NORMAL    = 4,        ///< Also matches LOG_LEVEL_INSANE, both are written without a tag
+            LEVEL_DEBUG     = 8,
+            LEVEL_ALL       = 15
+        };
+        
+        /**
+         * @brief    Conditions a record has to meet, empty strings match every record.
+         *           Lines without a header (continuation lines of multi-line messages) only match filters without level, thread and time conditions.
+         */
+        struct Filter
+        {
+            unsigned        levels;             ///< Combination of LevelMask values
+            std::string     threadId;           ///< Thread id as written in the header
+            std::string     substring;          ///< Searched in the message
+            std::string     fromTime;           ///< Records older than this are skipped, e.g. "2019-02-08-10-00". Compared with the timestamp up to its length
+            std::string     toTime;             ///< Records newer than this are skipped, inclusive up to its length, e.g. "2019-02-08-11" includes 11:59
+            
+            Filter() : levels(LEVEL_ALL) {}
+        };
+        
+        /**
+         * @brief    Receives matching records in file order, without the new line character. Called by the thread calling the scan.
+         */
+        typedef std::function<void(const char* data, size_t size)> RecordHandler;
+        
+        /**
+         * @brief                       Scans a file.
+         * @param    filePath           Path to the log file.
+         * @param    filter             Conditions of the records to report.
+         * @param    handler            Called for each matching record.
+         * @param    matchCount         Set to the number of matching records.
+         * @param    threadCount        Number of scanning threads, 0 for the number of hardware threads.
+         * @return                      RES_OK if successful, RES_FILE_ERROR if the file cannot be mapped, RES_BAD_ARGS if the filter cannot match any record.
+         */
+        static Logger::Result scanFile(const std::string& filePath, const Filter& filter, const RecordHandler& handler, size_t& matchCount, unsigned threadCount = 0);
+        
+        /**
+         * @brief                       Scans a buffer holding records.
+         * @param    data               Start of the buffer.
+         * @param    size               Size of the buffer.
+         * @param    filter             Conditions of the records to report.
+         * @param    handler            Called for each matching record.
+         * @param    threadCount        Number of scanning threads, 0 for the number of hardware threads.
+         * @return                      Number of matching records.
+         */
+        static size_t scanBuffer(const char* data, size_t size, const Filter& filter, const RecordHandler& handler, unsigned threadCount = 1);
+        
+        /**
+         * @brief                       Selects the search kernel. Not to be called while scans are running.
+         * @param    kernel             The kernel, KERNEL_AUTO for the best one.
+         * @return                      false if the CPU does not support the kernel, the selection is not changed then.
+         */
+        static bool setKernel(Kernel kernel);
+        
+        /**
+         * @brief                       Gets the selected search kernel.
+         * @return                      The kernel, never KERNEL_AUTO.
+         */
+        static Kernel getKernel();
+        
+        static const char* getKernelName(Kernel kernel);
+    };
+}
+
+#endif /* LogScanner_h */
@@ -7,25 +7,147 @@
 //
 
 #include "Logger.h"
+#include "LoggerDetail.h"
 #include <mutex>
 #include <fstream>
 #include <chrono>
 #include <thread>
 #include <algorithm>
 #include <iomanip>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <deque>
 #ifdef _MSC_VER
-#define SPRINTF sprintf_s
+#include <io.h>
+#include <fcntl.h>
 #else
-#define SPRINTF std::sprintf
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <errno.h>
+#endif
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #endif
 
 //Logger defines
-#define RW_DEFAULT_MAX_LOG_LENGTH    (1024*1024)
+#define RW_DEFAULT_MAX_OPEN_FILES    64
+#define RW_DEFAULT_ASYNC_CAPACITY    8192
+#define RW_FILE_CHECK_INTERVAL_MS    250                // How often a cached file is compared with its path to detect an external rename or removal
+#define RW_RECORD_OVERHEAD           49                 // Header and new line of a record, counted by the load governor
+#define RW_GOVERNOR_THREAD_SLOTS     8                  // Governors a thread keeps separate statement counters for
+#define RW_SHARED_MAGIC              0x52574c32u        // "RWL2", marks an initialized control file with writer slots
+#define RW_SHARED_MAX_PROCESSES      128                // Processes which can share a file at the same time
+#ifdef PIPE_BUF
+#define RW_SHARED_MAX_RECORD         PIPE_BUF           // Longest line written to a shared file with a single write
+#else
+#define RW_SHARED_MAX_RECORD         512
+#endif
+#define RW_SHARED_DRAIN_TIMEOUT_MS   1000               // How long maintenance waits for writers of other processes before it is retried later
+#define RW_RING_MAGIC                0x52574752u        // "RWGR", marks an initialized ring file
+#define RW_RING_PUBLISH_TIMEOUT_MS   5000               // How long the daemon waits for a claimed slot of a live producer
+#define RW_RING_ABANDONED            (1ull << 63)       // Flag of a slot sequence skipped by the daemon while its producer may still write the slot
 
 namespace rw
 {
     //Logger related implementations
     
+    //Queue of the I/O thread, used by doLog and the asynchronous logging implementations
+    struct Logger::AsyncRequest
+    {
+        Level                   level;
+        std::string             header;
+        std::string             message;
+        bool                    record;         ///< false for flush requests
+        bool                    sync;           ///< Completes after the file is synced
+        Completion              completion;
+        Executor                executor;
+    };
+    
+    struct Logger::AsyncWriter
+    {
+        std::deque<AsyncRequest>    queue;
+        size_t                      recordCount = 0;    ///< Fire-and-forget records in the queue or in the batch being written
+        std::condition_variable     cond;
+        std::thread                 thread;
+        bool                        stop = false;
+        bool                        orphaned = false;   ///< The logger was destroyed on the I/O thread, only that thread uses the writer then
+    };
+    
+    //Background thread of asynchronous rotation, see the asynchronous rotation implementations
+    struct Logger::RotationWorker
+    {
+        std::mutex                  mutex;
+        std::condition_variable     cond;
+        std::thread                 thread;
+        std::string                 nextPath;           ///< Where the next file is prepared
+        std::fstream                *pNext = nullptr;   ///< Prepared file, taken by rotateToNextFile
+        std::vector<std::pair<std::fstream*, std::string> > retired;   ///< Rotated files to close, with their new paths
+        size_t                      preallocateSize = 0;
+        bool                        syncRotated = false;
+        bool                        stop = false;
+    };
+    
+    //Measurements of the load governor, see the load governor implementations
+    struct Logger::Governor
+    {
+        const unsigned long long            id;                     ///< Key of the statement counters of the threads, never reused
+        std::mutex                          mutex;                  ///< Protects the members which are not atomic
+        GovernorConfig                      config;
+        std::atomic<bool>                   enabled;
+        std::atomic<unsigned>               sampleInterval;         ///< Copy of config.sampleInterval read without the lock
+        std::atomic<unsigned long long>     bytes;                  ///< Bytes logged in the window, estimated from the sampled records
+        std::atomic<unsigned long long>     records;                ///< Records logged in the window, estimated from the sampled records
+        std::atomic<unsigned long long>     shedRecords;            ///< Statements shed in the window, estimated from the sampled ones
+        std::atomic<unsigned long long>     totalShedRecords;
+        std::vector<unsigned>               latencies;              ///< Sampled latencies of the window in microseconds
+        std::chrono::steady_clock::time_point windowStart;
+        double                              recordSize;             ///< Average size of a record, used to estimate the load of shed statements
+        unsigned                            calmWindows;            ///< Consecutive windows under half of the budgets
+        unsigned long long                  sheds;
+        unsigned long long                  restores;
+        
+        Governor(unsigned long long governorId) : id(governorId), enabled(false), sampleInterval(1), bytes(0), records(0), shedRecords(0), totalShedRecords(0),
+        recordSize(100), calmWindows(0), sheds(0), restores(0) {}
+    };
+    
+    //Statements a thread logged and shed for one governor
+    struct GovernorThreadCounters
+    {
+        unsigned long long                  governorId;             ///< Governor the counters belong to, 0 if unused
+        unsigned                            statements;
+        unsigned                            shed;
+    };
+    
+    static std::atomic<unsigned long long> s_nextGovernorId(1);
+    
+    /**
+     * @brief                       Returns the counters of the calling thread for a governor, so that loggers do not shift the sampling of each other.
+     * @param   governorId          Id of the governor.
+     * @return                      Counters, reset if another governor used them last.
+     */
+    static GovernorThreadCounters& getGovernorThreadCounters(unsigned long long governorId)
+    {
+        thread_local GovernorThreadCounters counters[RW_GOVERNOR_THREAD_SLOTS] = {};
+        GovernorThreadCounters& slot = counters[governorId % RW_GOVERNOR_THREAD_SLOTS];
+        if(slot.governorId != governorId)
+        {
+            slot.governorId = governorId;
+            slot.statements = 0;
+            slot.shed = 0;
+        }
+        return slot;
+    }
+    
     Logger::Logger()
     {
         m_path = "";
@@ -35,6 +157,23 @@ namespace rw
         m_maxLogSize = RW_DEFAULT_MAX_LOG_LENGTH;
         m_pFile = (std::fstream*) new std::fstream();
         m_overflowAction = Logger::ACTION_TRUNCATE;
+        m_floatFormat = Logger::FLOAT_FORMAT_STREAM;
+        m_pShared = nullptr;
+        m_pRing = nullptr;
+        m_fileCached = false;
+        m_fileUseStamp = 0;
+        m_fileCacheHits = 0;
+        m_fileDevice = 0;
+        m_fileInode = 0;
+        m_pAsync = nullptr;
+        m_asyncLogging = false;
+        m_asyncCapacity = RW_DEFAULT_ASYNC_CAPACITY;
+        m_asyncDropped = 0;
+        m_pRotation = nullptr;
+        m_pGovernor = nullptr;
+        m_shedLevel = Logger::LOG_LEVEL_INSANE;
+        m_writeErrors = 0;
+        m_tornRecord = false;
     }
     
     Logger::Logger(const std::string& logFilePath, const OverflowAction& action)
@@ -46,29 +185,155 @@ namespace rw
         m_maxLogSize = RW_DEFAULT_MAX_LOG_LENGTH;
         m_pFile = (std::fstream*) new std::fstream();
         m_overflowAction = action;
+        m_floatFormat = Logger::FLOAT_FORMAT_STREAM;
+        m_pShared = nullptr;
+        m_pRing = nullptr;
+        m_fileCached = false;
+        m_fileUseStamp = 0;
+        m_fileCacheHits = 0;
+        m_fileDevice = 0;
+        m_fileInode = 0;
+        m_pAsync = nullptr;
+        m_asyncLogging = false;
+        m_asyncCapacity = RW_DEFAULT_ASYNC_CAPACITY;
+        m_asyncDropped = 0;
+        m_pRotation = nullptr;
+        m_pGovernor = nullptr;
+        m_shedLevel = Logger::LOG_LEVEL_INSANE;
+        m_writeErrors = 0;
+        m_tornRecord = false;
     }
     
     Logger::~Logger()
     {
+        stopAsync();
+        stopRotation();
+        closeRing();
+        closeShared();
         close();
         if(m_pFile) {
             delete (std::fstream*) m_pFile;
             m_pFile = nullptr;
         }
+        delete m_pGovernor.load();
     }
     
     Logger::Result Logger::open()
     {
         std::lock_guard<std::recursive_mutex> lk(m_logMutex);
-        if ( ((std::fstream*)m_pFile)->is_open()) return Logger::RES_OK;
+        if ( ((std::fstream*)m_pFile)->is_open())
+        {
+            //Hits only touch the members of this logger, the cache lock is taken for opening and evicting
+            if(!isFileReplaced())
+            {
+                m_fileCacheHits.fetch_add(1, std::memory_order_relaxed);
+                m_fileUseStamp.store(m_fileCacheClock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                return Logger::RES_OK;
+            }
+            close();
+        }
         
         ((std::fstream*)m_pFile)->open( m_path.c_str(), std::ios::out | std::ios::app  );
-        return ((std::fstream*)m_pFile)->is_open() ? Logger::RES_OK : Logger::RES_FILE_ERROR;
+        if ( !((std::fstream*)m_pFile)->is_open()) return Logger::RES_FILE_ERROR;
+        
+        rememberFileIdentity();
+        cacheFile();
+        return Logger::RES_OK;
     }
     
     void Logger::close()
     {
         if (((std::fstream*)m_pFile)->is_open()) ((std::fstream*)m_pFile)->close();
+        
+        std::lock_guard<std::mutex> cacheLk(m_fileCacheMutex);
+        m_fileCacheStats.hits += m_fileCacheHits.exchange(0, std::memory_order_relaxed);
+        if(m_fileCached)
+        {
+            m_openFiles.erase(m_fileCacheIt);
+            m_fileCached = false;
+        }
+    }
+    
+    void Logger::rememberFileIdentity()
+    {
+        m_fileCheckTime = std::chrono::steady_clock::now();
+#ifndef _MSC_VER
+        struct stat st;
+        if(::stat(m_path.c_str(), &st) == 0)
+        {
+            m_fileDevice = static_cast<unsigned long long>(st.st_dev);
+            m_fileInode = static_cast<unsigned long long>(st.st_ino);
+        }
+#endif
+    }
+    
+    bool Logger::isFileReplaced()
+    {
+#ifdef _MSC_VER
+        //Files opened by fstream cannot be renamed or removed on Windows
+        return false;
+#else
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(now - m_fileCheckTime < std::chrono::milliseconds(RW_FILE_CHECK_INTERVAL_MS)) {
+            return false;
+        }
+        m_fileCheckTime = now;
+        
+        struct stat st;
+        return ::stat(m_path.c_str(), &st) != 0 || static_cast<unsigned long long>(st.st_dev) != m_fileDevice ||
+               static_cast<unsigned long long>(st.st_ino) != m_fileInode;
+#endif
+    }
+    
+    void Logger::cacheFile()
+    {
+        std::lock_guard<std::mutex> cacheLk(m_fileCacheMutex);
+        m_fileCacheStats.misses++;
+        
+        //Without a limit the caller closes the file after the record
+        const size_t maxOpenFiles = m_maxOpenFiles.load(std::memory_order_relaxed);
+        if(maxOpenFiles == 0) {
+            return;
+        }
+        
+        m_fileCacheIt = m_openFiles.insert(m_openFiles.begin(), this);
+        m_fileCached = true;
+        m_fileUseStamp.store(m_fileCacheClock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        evictFiles(maxOpenFiles, this);
+    }
+    
+    void Logger::evictFiles(size_t maxOpenFiles, const Logger* pExcept)
+    {
+        if(m_openFiles.size() <= maxOpenFiles) {
+            return;
+        }
+        
+        //Use stamps are updated without the lock, the order is only decided here
+        typedef std::pair<unsigned long long, FileCacheList::iterator> Candidate;
+        std::vector<Candidate> candidates;
+        candidates.reserve(m_openFiles.size());
+        for(FileCacheList::iterator it = m_openFiles.begin(); it != m_openFiles.end(); ++it)
+        {
+            if(*it != pExcept) candidates.push_back(Candidate((*it)->m_fileUseStamp.load(std::memory_order_relaxed), it));
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.first < b.first; });
+        
+        for(size_t i=0; i < candidates.size() && m_openFiles.size() > maxOpenFiles; i++)
+        {
+            Logger* pVictim = *candidates[i].second;
+            
+            //The owner of a busy logger may be waiting for m_fileCacheMutex, waiting for its lock here could deadlock
+            if(!pVictim->m_logMutex.try_lock()) {
+                continue;
+            }
+            ((std::fstream*)pVictim->m_pFile)->close();
+            pVictim->m_fileCached = false;
+            m_fileCacheStats.hits += pVictim->m_fileCacheHits.exchange(0, std::memory_order_relaxed);
+            pVictim->m_logMutex.unlock();
+            
+            m_openFiles.erase(candidates[i].second);
+            m_fileCacheStats.evictions++;
+        }
     }
     
     void Logger::setEnabled( bool enabled )
@@ -98,8 +363,13 @@ namespace rw
     void Logger::setMaxLogSize( size_t maxLen )
     {
         std::lock_guard<std::recursive_mutex> lk(m_logMutex);
-        if (maxLen<=m_minLogSize) maxLen = m_minLogSize;
+        if (maxLen<=RW_MIN_LOG_LENGTH) maxLen = RW_MIN_LOG_LENGTH;
         m_maxLogSize = maxLen;
+        if(m_pRotation)
+        {
+            std::lock_guard<std::mutex> rotationLk(m_pRotation->mutex);
+            m_pRotation->preallocateSize = maxLen;
+        }
     }
     
     size_t Logger::getMaxLogSize() const
@@ -109,8 +379,8 @@ namespace rw
     
     void Logger::setLogLevel( Level level )
     {
-        std::lock_guard<std::recursive_mutex> lk(m_logMutex);
-        m_logLevel = level;
+        // Read by writers without locking
+        m_logLevel.store(level, std::memory_order_relaxed);
     }
     
     Logger::Level Logger::getLogLevel() const
@@ -118,6 +388,21 @@ namespace rw
         return m_logLevel;
     }
     
+    void Logger::setFloatFormat( FloatFormat format )
+    {
+        m_floatFormat = format;
+    }
+    
+    Logger::FloatFormat Logger::getFloatFormat() const
+    {
+        return m_floatFormat;
+    }
+    
+    unsigned long long Logger::getWriteErrorCount() const
+    {
+        return m_writeErrors.load();
+    }
+    
     std::string Logger::getPath() const
     {
         return m_path;
@@ -126,258 +411,2116 @@ namespace rw
     size_t Logger::getLogSize()
     {
         std::lock_guard<std::recursive_mutex> lk(m_logMutex);
-        if( open() == Logger::RES_OK ) {
+        if( m_pShared ) {
+            return getSharedLogSize();
+        }
+        if( ((std::fstream*)m_pFile)->is_open() || open() == Logger::RES_OK ) {
             ((std::fstream*)m_pFile)->seekp(0, std::ios::end );
             size_t size = (size_t) ((std::fstream*)m_pFile)->tellp();
-			close();
+            if(m_maxOpenFiles.load(std::memory_order_relaxed) == 0) close();
             return size;
         }
         return 0;
     }
     
-    static std::string getLogLevelString(const Logger::Level& level )
+    //Record headers are built by the helpers shared with BasicLogger
+    using detail::getTimeAndDateString;
+    using detail::getThreadIDString;
+    using detail::getRecordHeader;
+    
+    //Number formatting kernels used by logstream
+    
+    static const char s_digitPairs[201] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+    
+    // Writes decimal digits of value backwards, ending just before pEnd. Returns the first written character.
+    static char* formatUnsigned(unsigned long long value, char* pEnd)
     {
-        if (level==Logger::LOG_LEVEL_ERROR) return std::string("ERR");
-        else if (level==Logger::LOG_LEVEL_WARNING) return std::string("WRN");
-        else if (level==Logger::LOG_LEVEL_DEBUG) return std::string("DBG");
-        else return std::string("   ");
+        while(value >= 100)
+        {
+            const size_t idx = static_cast<size_t>(value % 100) * 2;
+            value /= 100;
+            *--pEnd = s_digitPairs[idx + 1];
+            *--pEnd = s_digitPairs[idx];
+        }
+        if(value >= 10)
+        {
+            const size_t idx = static_cast<size_t>(value) * 2;
+            *--pEnd = s_digitPairs[idx + 1];
+            *--pEnd = s_digitPairs[idx];
+        }
+        else
+        {
+            *--pEnd = static_cast<char>('0' + value);
+        }
+        return pEnd;
     }
     
-    static std::string getTimeAndDateString()
+    // Shortest round trip formatting of binary floating point values using Grisu2 (Florian Loitsch, "Printing
+    // Floating-Point Numbers Quickly and Accurately with Integers", PLDI 2010). Output always round trips and is
+    // the shortest representation for ~99.9% of the inputs, remaining ones get one extra digit.
+    
+    struct DiyFp
     {
-        std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
-        std::chrono::system_clock::duration tp = now.time_since_epoch();
-        tp -= std::chrono::duration_cast<std::chrono::seconds>(tp);
-        time_t tt = std::chrono::system_clock::to_time_t(now);
-
-#ifdef _MSC_VER
-		tm t;
-		localtime_s(&t, &tt);
-#else
-        const tm t = *localtime(&tt);
-#endif
-        
-        char buff[30];
-        SPRINTF(buff, "[%04u-%02u-%02u-%02u-%02u-%02u-%03u]", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, static_cast<unsigned>(tp / std::chrono::milliseconds(1)));
-        
-        return std::string(buff);
+        uint64_t f;
+        int e;
+        DiyFp(uint64_t f_ = 0, int e_ = 0) : f(f_), e(e_) {}
+    };
+    
+    static DiyFp diyFpSub(const DiyFp& x, const DiyFp& y)
+    {
+        return DiyFp(x.f - y.f, x.e);
     }
     
-    static std::string getThreadIDString()
+    // Upper 64 bits of the 128 bit product, rounded
+    static DiyFp diyFpMul(const DiyFp& x, const DiyFp& y)
     {
-        auto threadId = std::this_thread::get_id();
-
-#ifdef _MSC_VER
-        uint64_t n=0;
-        std::stringstream ss;
-        ss << threadId;
-        ss >> std::dec >> n;
-        ss = std::stringstream();
-        ss << std::setw(16) << std::setfill('0') << std::hex << n;
-#else
-        std::stringstream ss;
-        ss << std::setw(16) << std::setfill('0') << threadId;
-#endif
-        return std::string(ss.str());
+        const uint64_t uLo = x.f & 0xFFFFFFFFu;
+        const uint64_t uHi = x.f >> 32;
+        const uint64_t vLo = y.f & 0xFFFFFFFFu;
+        const uint64_t vHi = y.f >> 32;
+        
+        const uint64_t p0 = uLo * vLo;
+        const uint64_t p1 = uLo * vHi;
+        const uint64_t p2 = uHi * vLo;
+        const uint64_t p3 = uHi * vHi;
+        
+        uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+        q += uint64_t(1) << 31;
+        
+        return DiyFp(p3 + (p1 >> 32) + (p2 >> 32) + (q >> 32), x.e + y.e + 64);
     }
     
-    void Logger::doLog(const Level& level, const std::string& message)
+    static DiyFp diyFpNormalize(DiyFp x)
     {
-        if(!m_enabled) {
-            return;
-        }
-        if(level > m_logLevel)
+        while((x.f >> 63) == 0)
         {
-            return;
+            x.f <<= 1;
+            x.e--;
         }
+        return x;
+    }
+    
+    struct CachedPower
+    {
+        uint64_t f;
+        int e;
+        int k;
+    };
+    
+    static const int s_grisuAlpha = -60;
+    static const int s_grisuGamma = -32;
+    static const int s_cachedPowersMinDecExp = -300;
+    static const int s_cachedPowersMaxDecExp = 324;
+    static const int s_cachedPowersDecStep = 8;
+    
+    // Minimal arbitrary precision unsigned integer, only used once to build the cached powers of ten
+    struct BigUInt
+    {
+        std::vector<uint32_t> words;    ///< Little endian 32 bit words
         
-        const std::string lvl = getLogLevelString(level);
+        explicit BigUInt(uint32_t v) : words(1, v) {}
         
-        std::stringstream messageStream;
-        messageStream << getTimeAndDateString() << " " << getThreadIDString() << " " << lvl << "| " << message << std::endl;
+        void mulSmall(uint32_t m)
+        {
+            uint64_t carry = 0;
+            for(size_t i = 0; i < words.size(); ++i)
+            {
+                const uint64_t t = uint64_t(words[i]) * m + carry;
+                words[i] = static_cast<uint32_t>(t);
+                carry = t >> 32;
+            }
+            if(carry) words.push_back(static_cast<uint32_t>(carry));
+        }
         
+        void shiftLeft1()
         {
-            std::lock_guard<std::recursive_mutex> lk(m_logMutex);
-            
-            if(m_overflowAction != ACTION_NONE)
+            uint32_t carry = 0;
+            for(size_t i = 0; i < words.size(); ++i)
             {
-                const size_t logSize = getLogSize();
-                if(logSize > m_maxLogSize)
-                {
-                    if(m_overflowAction == ACTION_TRUNCATE)
-                    {
-                        truncate(m_maxLogSize/2);
-                    }
-                    if(m_overflowAction == ACTION_ROTATE)
-                    {
-                        rotate();
-                    }
-                }
+                const uint32_t next = words[i] >> 31;
+                words[i] = (words[i] << 1) | carry;
+                carry = next;
             }
-            
-            if(open() == RES_OK)
+            if(carry) words.push_back(carry);
+        }
+        
+        int compare(const BigUInt& other) const
+        {
+            if(words.size() != other.words.size()) return words.size() < other.words.size() ? -1 : 1;
+            for(size_t i = words.size(); i-- > 0; )
             {
-                *((std::fstream*)m_pFile) << messageStream.str();
-                close();
+                if(words[i] != other.words[i]) return words[i] < other.words[i] ? -1 : 1;
             }
-            
-            if(m_reflectToConsole)
+            return 0;
+        }
+        
+        // Assumes *this >= other
+        void subtract(const BigUInt& other)
+        {
+            int64_t borrow = 0;
+            for(size_t i = 0; i < words.size(); ++i)
             {
-                std::ostream &ostr = (level == LOG_LEVEL_ERROR) ? std::cerr : std::cout;
-                ostr << messageStream.str();
+                int64_t t = int64_t(words[i]) - borrow - (i < other.words.size() ? int64_t(other.words[i]) : 0);
+                borrow = t < 0 ? 1 : 0;
+                words[i] = static_cast<uint32_t>(t + (borrow << 32));
             }
+            while(words.size() > 1 && words.back() == 0) words.pop_back();
         }
-    }
+        
+        int bitLength() const
+        {
+            int len = static_cast<int>(words.size() - 1) * 32;
+            for(uint32_t top = words.back(); top; top >>= 1) len++;
+            return len;
+        }
+        
+        bool bit(int i) const
+        {
+            return i >= 0 && (words[i / 32] >> (i % 32)) & 1u;
+        }
+    };
     
-    Logger::Result Logger::truncate( size_t newLen )
+    // Normalized 64 bit approximation of 10^k, correctly rounded
+    static CachedPower computePowerOfTen(int k)
     {
-        if(newLen<m_minLogSize) {
-            newLen = m_minLogSize;
-        }
+        BigUInt d(1);
+        for(int i = 0; i < (k < 0 ? -k : k); ++i) d.mulSmall(10);
+        const int len = d.bitLength();
         
-        std::fstream inFile;
-        inFile.open( m_path.c_str(), std::ios::in | std::ios::binary );
-        if(inFile.is_open())
+        CachedPower res;
+        res.k = k;
+        bool roundUp = false;
+        if(k >= 0)
         {
-            inFile.seekp(-int(newLen), std::ios::end );
-            std::string timeStr = getTimeAndDateString();
-            
-            std::fstream tempFile;
-            std::string tempFileName(m_path+"_"+timeStr+".log");
-            
-            tempFile.open( tempFileName.c_str(), std::ios::out | std::ios::binary );
-            if(tempFile.is_open())
+            res.f = 0;
+            for(int i = 0; i < 64; ++i) res.f = (res.f << 1) | (d.bit(len - 1 - i) ? 1u : 0u);
+            res.e = len - 64;
+            roundUp = d.bit(len - 65);
+        }
+        else
+        {
+            // Long division of 2^(len-1+i) by 10^-k, the quotient of 2^(len+63) has exactly 64 bits
+            BigUInt r(1);
+            for(int i = 0; i < len - 1; ++i) r.shiftLeft1();
+            res.f = 0;
+            for(int i = 0; i < 65; ++i)
             {
-                std::string line;
-                while(std::getline(inFile, line))
-                {
-                    if(line.length()>0) {
-                        tempFile << line << std::endl;
-                    }
-                }
-                tempFile.close();
+                r.shiftLeft1();
+                const bool b = r.compare(d) >= 0;
+                if(b) r.subtract(d);
+                if(i < 64) res.f = (res.f << 1) | (b ? 1u : 0u);
+                else roundUp = b;
             }
-            
-            //rename
-            inFile.close();
-            remove(m_path.c_str());
-            rename(tempFileName.c_str(), m_path.c_str());
-            
-            return RES_OK;
+            res.e = -(len + 63);
         }
-        return RES_ERROR;
+        if(roundUp)
+        {
+            res.f++;
+            if(res.f == 0)
+            {
+                res.f = uint64_t(1) << 63;
+                res.e++;
+            }
+        }
+        return res;
     }
     
-    Logger::Result Logger::rotate()
+    static std::vector<CachedPower> computeCachedPowers()
     {
-        std::string timeStr = getTimeAndDateString();
-        std::string newFileName(m_path+"_"+timeStr+".log");
-        
-        close();
-        rename(m_path.c_str(), newFileName.c_str());
-        
-        return RES_OK;
+        std::vector<CachedPower> powers;
+        for(int k = s_cachedPowersMinDecExp; k <= s_cachedPowersMaxDecExp; k += s_cachedPowersDecStep) {
+            powers.push_back(computePowerOfTen(k));
+        }
+        return powers;
     }
     
-    //Manager related implementations
-    
-    const std::string Logger::defaultLoggerFilePath = "rw_default_log.txt";
-    const std::string Logger::consoleLoggerFilePath = "";
-    std::recursive_mutex Logger::m_managerMutex;
-    Logger::LoggerContainer Logger::m_loggers;
+    static const std::vector<CachedPower>& getCachedPowers()
+    {
+        static const std::vector<CachedPower> powers = computeCachedPowers();
+        return powers;
+    }
     
-    Logger::Result Logger::init()
+    // Returns c = 10^k such that alpha <= e + c.e + 64 <= gamma
+    static const CachedPower& getCachedPowerForBinaryExponent(int e)
     {
-        LogPtr consoleLogger = getConsoleLogger();
-        if(consoleLogger) {
-            return RES_OK;
-        }
-        return RES_MEMORY_ERROR;
+        const int f = s_grisuAlpha - e - 1;
+        const int k = (f * 78913) / (1 << 18) + static_cast<int>(f > 0);
+        const int index = (-s_cachedPowersMinDecExp + k + (s_cachedPowersDecStep - 1)) / s_cachedPowersDecStep;
+        return getCachedPowers()[index];
     }
     
-    Logger::LogPtr Logger::getConsoleLogger()
+    // Computes the normalized value and its normalized boundaries m- and m+ sharing the exponent of m+
+    template<typename FloatType>
+    static void computeBoundaries(FloatType value, DiyFp& w, DiyFp& wMinus, DiyFp& wPlus)
     {
-        std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
-        const LoggerContainer::iterator it = m_loggers.find(consoleLoggerFilePath);
+        const int precision = std::numeric_limits<FloatType>::digits;
+        const int bias = std::numeric_limits<FloatType>::max_exponent - 1 + (precision - 1);
+        const int minExp = 1 - bias;
+        const uint64_t hiddenBit = uint64_t(1) << (precision - 1);
         
-        LogPtr res;
-        if(it != m_loggers.end()) {
-            res = it->second;
+        uint64_t bits = 0;
+        if(sizeof(FloatType) == sizeof(uint32_t))
+        {
+            uint32_t b;
+            std::memcpy(&b, &value, sizeof(b));
+            bits = b;
         }
         else
         {
-            Logger* pLogger = new (std::nothrow) Logger(consoleLoggerFilePath, ACTION_NONE);
-            if(pLogger) {
-                pLogger->setReflectToConsole(true);
-                res = LogPtr(pLogger);
-                m_loggers[consoleLoggerFilePath] = res;
-            }
+            std::memcpy(&bits, &value, sizeof(bits));
         }
-        return res;
+        
+        const uint64_t biasedExp = bits >> (precision - 1);
+        const uint64_t fraction = bits & (hiddenBit - 1);
+        
+        const DiyFp v = (biasedExp == 0) ? DiyFp(fraction, minExp) : DiyFp(fraction + hiddenBit, static_cast<int>(biasedExp) - bias);
+        const bool lowerBoundaryIsCloser = (fraction == 0 && biasedExp > 1);
+        
+        const DiyFp mPlus(2 * v.f + 1, v.e - 1);
+        const DiyFp mMinus = lowerBoundaryIsCloser ? DiyFp(4 * v.f - 1, v.e - 2) : DiyFp(2 * v.f - 1, v.e - 1);
+        
+        wPlus = diyFpNormalize(mPlus);
+        wMinus = DiyFp(mMinus.f << (mMinus.e - wPlus.e), wPlus.e);
+        w = diyFpNormalize(v);
     }
     
-    Logger::LogPtr Logger::getDefaultLogger(const Logger::OverflowAction& overflowAction)
+    static int findLargestPow10(uint32_t n, uint32_t& pow10)
     {
-        std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
-        const LoggerContainer::iterator it = m_loggers.find(defaultLoggerFilePath);
-        
-        LogPtr res;
-        if(it != m_loggers.end()) {
-            res = it->second;
-        }
-        else
+        static const uint32_t powers[] = { 1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u };
+        int digits = 10;
+        while(digits > 1 && n < powers[digits - 1]) digits--;
+        pow10 = powers[digits - 1];
+        return digits;
+    }
+    
+    static void grisu2Round(char* buf, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t tenK)
+    {
+        while(rest < dist && delta - rest >= tenK && (rest + tenK < dist || dist - rest > rest + tenK - dist))
         {
-            Logger* pLogger = new (std::nothrow) Logger(defaultLoggerFilePath, overflowAction);
-            if(pLogger) {
-                res = LogPtr(pLogger);
-                m_loggers[defaultLoggerFilePath] = res;
-            }
-            else
-            {
-                res = getConsoleLogger();
-            }
+            buf[len - 1]--;
+            rest += tenK;
         }
-        return res;
     }
     
-    Logger::LogPtr Logger::getFileLogger(const std::string& filePath, const Logger::OverflowAction& overflowAction)
+    static void grisu2DigitGen(char* buf, int& len, int& decimalExponent, const DiyFp& mMinus, const DiyFp& w, const DiyFp& mPlus)
     {
-        std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
-        const LoggerContainer::iterator it = m_loggers.find(filePath);
+        uint64_t delta = diyFpSub(mPlus, mMinus).f;
+        uint64_t dist = diyFpSub(mPlus, w).f;
         
-        LogPtr res;
-        if(it != m_loggers.end()) {
-            res = it->second;
-        }
-        else
+        const DiyFp one(uint64_t(1) << -mPlus.e, mPlus.e);
+        uint32_t p1 = static_cast<uint32_t>(mPlus.f >> -one.e);
+        uint64_t p2 = mPlus.f & (one.f - 1);
+        
+        uint32_t pow10;
+        int n = findLargestPow10(p1, pow10);
+        while(n > 0)
         {
-            Logger* pLogger = new (std::nothrow) Logger(filePath, overflowAction);
-            if(pLogger) {
-                res = LogPtr(pLogger);
-                m_loggers[filePath] = res;
-            }
-            else
+            const uint32_t d = p1 / pow10;
+            p1 %= pow10;
+            buf[len++] = static_cast<char>('0' + d);
+            n--;
+            
+            const uint64_t rest = (uint64_t(p1) << -one.e) + p2;
+            if(rest <= delta)
             {
-                res = getConsoleLogger();
+                decimalExponent += n;
+                grisu2Round(buf, len, dist, delta, rest, uint64_t(pow10) << -one.e);
+                return;
             }
+            pow10 /= 10;
         }
-        return res;
+        
+        int m = 0;
+        for(;;)
+        {
+            p2 *= 10;
+            const uint64_t d = p2 >> -one.e;
+            p2 &= one.f - 1;
+            buf[len++] = static_cast<char>('0' + d);
+            m++;
+            delta *= 10;
+            dist *= 10;
+            if(p2 <= delta) break;
+        }
+        decimalExponent -= m;
+        grisu2Round(buf, len, dist, delta, p2, one.f);
     }
     
-    Logger::Result Logger::destroy(const std::string& filePath)
+    // Writes the digits of a positive finite value to buf, value = digits * 10^decimalExponent
+    template<typename FloatType>
+    static int grisu2(char* buf, int& decimalExponent, FloatType value)
     {
-        if(filePath == consoleLoggerFilePath)
-        {
-            return RES_BAD_ARGS; //Cannot remove console logger
-        }
-        if(filePath == defaultLoggerFilePath)
-        {
+        DiyFp w, mMinus, mPlus;
+        computeBoundaries(value, w, mMinus, mPlus);
+        
+        const CachedPower& cached = getCachedPowerForBinaryExponent(mPlus.e);
+        const DiyFp c(cached.f, cached.e);
+        
+        const DiyFp cw = diyFpMul(w, c);
+        const DiyFp cwMinus = diyFpMul(mMinus, c);
+        const DiyFp cwPlus = diyFpMul(mPlus, c);
+        
+        int len = 0;
+        decimalExponent = -cached.k;
+        grisu2DigitGen(buf, len, decimalExponent, DiyFp(cwMinus.f + 1, cwMinus.e), cw, DiyFp(cwPlus.f - 1, cwPlus.e));
+        return len;
+    }
+    
+    // Lays out digits * 10^decimalExponent the way std::to_chars does without a format:
+    // fixed notation unless scientific notation is strictly shorter.
+    static char* formatDecimal(char* p, const char* digits, int len, int decimalExponent)
+    {
+        const int point = len + decimalExponent;     // Number of digits before the decimal point
+        const int sciExp = point - 1;
+        const int sciExpAbs = sciExp < 0 ? -sciExp : sciExp;
+        
+        int fixedLen;
+        if(decimalExponent >= 0) fixedLen = point;
+        else if(point > 0) fixedLen = len + 1;
+        else fixedLen = 2 - point + len;
+        const int sciLen = len + (len > 1 ? 1 : 0) + 2 + (sciExpAbs >= 100 ? 3 : 2);
+        
+        if(fixedLen <= sciLen)
+        {
+            if(decimalExponent >= 0)
+            {
+                std::memcpy(p, digits, len);
+                p += len;
+                for(int i = 0; i < decimalExponent; ++i) *p++ = '0';
+            }
+            else if(point > 0)
+            {
+                std::memcpy(p, digits, point);
+                p += point;
+                *p++ = '.';
+                std::memcpy(p, digits + point, len - point);
+                p += len - point;
+            }
+            else
+            {
+                *p++ = '0';
+                *p++ = '.';
+                for(int i = 0; i < -point; ++i) *p++ = '0';
+                std::memcpy(p, digits, len);
+                p += len;
+            }
+        }
+        else
+        {
+            *p++ = digits[0];
+            if(len > 1)
+            {
+                *p++ = '.';
+                std::memcpy(p, digits + 1, len - 1);
+                p += len - 1;
+            }
+            *p++ = 'e';
+            *p++ = sciExp < 0 ? '-' : '+';
+            char expBuf[4];
+            char* pExp = formatUnsigned(static_cast<unsigned long long>(sciExpAbs), expBuf + sizeof(expBuf));
+            if(sciExpAbs < 10) *p++ = '0';
+            while(pExp != expBuf + sizeof(expBuf)) *p++ = *pExp++;
+        }
+        return p;
+    }
+    
+    // Writes value with shortest round trip digits, returns one past the last written character. buf must hold 32 characters.
+    template<typename FloatType>
+    static char* formatShortest(FloatType value, char* p)
+    {
+        if(std::signbit(value))
+        {
+            *p++ = '-';
+            value = -value;
+        }
+        if(std::isnan(value))
+        {
+            std::memcpy(p, "nan", 3);
+            return p + 3;
+        }
+        if(std::isinf(value))
+        {
+            std::memcpy(p, "inf", 3);
+            return p + 3;
+        }
+        if(value == 0)
+        {
+            *p++ = '0';
+            return p;
+        }
+        
+        char digits[20];
+        int decimalExponent = 0;
+        const int len = grisu2(digits, decimalExponent, value);
+        return formatDecimal(p, digits, len, decimalExponent);
+    }
+    
+    bool Logger::logstream::isPlainFormat()
+    {
+        const std::ios_base::fmtflags fl = flags();
+        const std::ios_base::fmtflags base = fl & std::ios_base::basefield;
+        if(base != std::ios_base::dec && base != 0) return false;
+        if((fl & std::ios_base::floatfield) != 0) return false;
+        if(fl & (std::ios_base::showpos | std::ios_base::showpoint | std::ios_base::uppercase)) return false;
+        if(width() != 0) return false;
+        if(m_classicLocale < 0) {
+            m_classicLocale = (getloc() == std::locale::classic()) ? 1 : 0;
+        }
+        return m_classicLocale == 1;
+    }
+    
+    void Logger::logstream::writeSigned(long long value)
+    {
+        char buf[24];
+        char* const pEnd = buf + sizeof(buf);
+        const unsigned long long magnitude = value < 0 ? 0ull - static_cast<unsigned long long>(value) : static_cast<unsigned long long>(value);
+        char* p = formatUnsigned(magnitude, pEnd);
+        if(value < 0) *--p = '-';
+        write(p, pEnd - p);
+    }
+    
+    void Logger::logstream::writeUnsigned(unsigned long long value)
+    {
+        char buf[24];
+        char* const pEnd = buf + sizeof(buf);
+        char* p = formatUnsigned(value, pEnd);
+        write(p, pEnd - p);
+    }
+    
+    Logger::logstream& Logger::logstream::operator<<(float value)
+    {
+        if(m_logger.m_floatFormat.load(std::memory_order_relaxed) == FLOAT_FORMAT_SHORTEST && isPlainFormat())
+        {
+            char buf[32];
+            write(buf, formatShortest(value, buf) - buf);
+        }
+        else
+        {
+            static_cast<std::ostream&>(*this) << value;
+        }
+        return *this;
+    }
+    
+    Logger::logstream& Logger::logstream::operator<<(double value)
+    {
+        if(m_logger.m_floatFormat.load(std::memory_order_relaxed) == FLOAT_FORMAT_SHORTEST && isPlainFormat())
+        {
+            char buf[32];
+            write(buf, formatShortest(value, buf) - buf);
+        }
+        else
+        {
+            static_cast<std::ostream&>(*this) << value;
+        }
+        return *this;
+    }
+    
+    void Logger::doLog(const Level& level, const std::string& message)
+    {
+        //Level and category filtering is done by logstream before anything is formatted
+        if(!m_enabled) {
+            return;
+        }
+        
+        Governor* pGovernor = m_pGovernor.load(std::memory_order_acquire);
+        if(!pGovernor || !pGovernor->enabled.load(std::memory_order_relaxed))
+        {
+            emitRecord(level, message);
+            return;
+        }
+        
+        //Statements are counted per thread and governor, only a sampled statement updates the shared counters on behalf of the whole interval
+        const unsigned sampleInterval = pGovernor->sampleInterval.load(std::memory_order_relaxed);
+        if(getGovernorThreadCounters(pGovernor->id).statements++ % sampleInterval != 0)
+        {
+            emitRecord(level, message);
+            return;
+        }
+        pGovernor->bytes.fetch_add(static_cast<unsigned long long>(sampleInterval) * (message.size() + RW_RECORD_OVERHEAD), std::memory_order_relaxed);
+        pGovernor->records.fetch_add(sampleInterval, std::memory_order_relaxed);
+        
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        emitRecord(level, message);
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lk(pGovernor->mutex);
+            pGovernor->latencies.push_back(static_cast<unsigned>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()));
+        }
+        checkGovernor(pGovernor, end);
+    }
+    
+    void Logger::emitRecord(const Level& level, const std::string& message)
+    {
+        if(m_pRing)
+        {
+            //The ring carries the raw time and thread id, the daemon formats the record
+            pushRing(level, message);
+            if(m_reflectToConsole)
+            {
+                std::lock_guard<std::recursive_mutex> lk(m_logMutex);
+                std::ostream &ostr = (level == LOG_LEVEL_ERROR) ? std::cerr : std::cout;
+                ostr << getRecordHeader(std::chrono::system_clock::now(), getThreadIDString(), level) << message << std::endl;
+            }
+            return;
+        }
+        
+        if(m_asyncLogging.load(std::memory_order_relaxed))
+        {
+            //The header is taken here to keep the time and thread of the statement
+            AsyncRequest request;
+            request.level = level;
+            request.header = getRecordHeader(std::chrono::system_clock::now(), getThreadIDString(), level);
+            request.message = message;
+            request.record = true;
+            request.sync = false;
+            enqueueAsync(request, true);
+            return;
+        }
+        
+        writeRecord(level, getRecordHeader(std::chrono::system_clock::now(), getThreadIDString(), level), message);
+    }
+    
+    void Logger::writeRecord(const Level& level, const std::string& header, const std::string& message)
+    {
+        std::string record;
+        record.reserve(header.size() + message.size() + 1);
+        record.append(header).append(message).push_back('\n');
+        
+        {
+            std::lock_guard<std::recursive_mutex> lk(m_logMutex);
+            
+            if(m_pShared)
+            {
+                writeShared(header, message);
+            }
+            else if(m_overflowAction != ACTION_NONE)
+            {
+                const size_t logSize = getLogSize();
+                if(logSize > m_maxLogSize)
+                {
+                    if(m_overflowAction == ACTION_TRUNCATE)
+                    {
+                        truncate(m_maxLogSize/2);
+                    }
+                    if(m_overflowAction == ACTION_ROTATE)
+                    {
+                        rotate();
+                    }
+                }
+            }
+            
+            if(!m_pShared && open() == RES_OK)
+            {
+                //A record cut by a failed write is ended first, so that the two do not share a line
+                std::fstream* pFile = (std::fstream*)m_pFile;
+                std::string torn;
+                const std::string& data = m_tornRecord ? torn.append("\n").append(record) : record;
+                m_tornRecord = false;
+                const size_t written = writeFile(data.data(), data.size(), [pFile](const char* p, size_t n) -> long {
+                    pFile->write(p, n);
+                    pFile->flush();
+                    return pFile->good() ? static_cast<long>(n) : -1;
+                });
+                
+                //The file stays open for the next record unless it is not cached or the stream failed, opening it again clears the failure
+                if(written < data.size())
+                {
+                    m_tornRecord = true;
+                    close();
+                }
+                else if(m_maxOpenFiles.load(std::memory_order_relaxed) == 0)
+                {
+                    close();
+                }
+            }
+            
+            if(m_reflectToConsole)
+            {
+                std::ostream &ostr = (level == LOG_LEVEL_ERROR) ? std::cerr : std::cout;
+                ostr << record;
+            }
+        }
+        
+        if(m_writeWaiters.load() > 0) {
+            notifyWrite();
+        }
+    }
+    
+    Logger::Result Logger::truncate( size_t newLen )
+    {
+        if(newLen<RW_MIN_LOG_LENGTH) {
+            newLen = RW_MIN_LOG_LENGTH;
+        }
+        close();
+        return detail::truncateFile(m_path, newLen) ? RES_OK : RES_ERROR;
+    }
+    
+    Logger::Result Logger::rotate()
+    {
+        const std::string newFileName = detail::getRotatedFilePath(m_path);
+        
+        if(m_pRotation && rotateToNextFile(newFileName)) {
+            return RES_OK;
+        }
+        
+        close();
+        rename(m_path.c_str(), newFileName.c_str());
+        
+        return RES_OK;
+    }
+    
+    //Load governor implementations
+    
+    Logger::Result Logger::setGovernor(const GovernorConfig& config)
+    {
+        if(config.windowMs == 0 || (config.maxLatencyUs == 0 && config.maxBytesPerSecond == 0 && config.maxBacklog == 0)) {
+            return RES_BAD_ARGS;
+        }
+        
+        Governor* pGovernor;
+        {
+            std::lock_guard<std::recursive_mutex> lk(m_logMutex);
+            pGovernor = m_pGovernor.load();
+            if(!pGovernor)
+            {
+                pGovernor = new Governor(s_nextGovernorId.fetch_add(1));
+                m_pGovernor.store(pGovernor, std::memory_order_release);
+            }
+        }
+        
+        std::lock_guard<std::mutex> lk(pGovernor->mutex);
+        pGovernor->config = config;
+        pGovernor->sampleInterval = config.sampleInterval > 0 ? config.sampleInterval : 1;
+        pGovernor->latencies.clear();
+        pGovernor->bytes = 0;
+        pGovernor->records = 0;
+        pGovernor->shedRecords = 0;
+        pGovernor->calmWindows = 0;
+        pGovernor->windowStart = std::chrono::steady_clock::now();
+        pGovernor->enabled = true;
+        return RES_OK;
+    }
+    
+    void Logger::removeGovernor()
+    {
+        Governor* pGovernor = m_pGovernor.load();
+        if(pGovernor)
+        {
+            std::lock_guard<std::mutex> lk(pGovernor->mutex);
+            pGovernor->enabled = false;
+        }
+        m_shedLevel = LOG_LEVEL_INSANE;
+    }
+    
+    Logger::GovernorStats Logger::getGovernorStats()
+    {
+        GovernorStats stats;
+        stats.level = static_cast<Level>(m_shedLevel.load());
+        stats.sheds = 0;
+        stats.restores = 0;
+        stats.shedRecords = 0;
+        
+        Governor* pGovernor = m_pGovernor.load();
+        if(pGovernor)
+        {
+            std::lock_guard<std::mutex> lk(pGovernor->mutex);
+            stats.sheds = pGovernor->sheds;
+            stats.restores = pGovernor->restores;
+            stats.shedRecords = pGovernor->totalShedRecords;
+        }
+        return stats;
+    }
+    
+    void Logger::shedRecord()
+    {
+        Governor* pGovernor = m_pGovernor.load(std::memory_order_acquire);
+        if(!pGovernor) {
+            return;
+        }
+        
+        //Shed statements are sampled like logged ones, they run when the logger is overloaded
+        const unsigned sampleInterval = pGovernor->sampleInterval.load(std::memory_order_relaxed);
+        if(getGovernorThreadCounters(pGovernor->id).shed++ % sampleInterval != 0) {
+            return;
+        }
+        pGovernor->shedRecords.fetch_add(sampleInterval, std::memory_order_relaxed);
+        pGovernor->totalShedRecords.fetch_add(sampleInterval, std::memory_order_relaxed);
+        checkGovernor(pGovernor, std::chrono::steady_clock::now());
+    }
+    
+    void Logger::checkGovernor(Governor* pGovernor, const std::chrono::steady_clock::time_point& now)
+    {
+        std::ostringstream transition;
+        {
+            //Another thread closing the window is enough
+            std::unique_lock<std::mutex> lk(pGovernor->mutex, std::try_to_lock);
+            if(!lk.owns_lock() || !pGovernor->enabled || now - pGovernor->windowStart < std::chrono::milliseconds(pGovernor->config.windowMs)) {
+                return;
+            }
+            const GovernorConfig& config = pGovernor->config;
+            
+            const double seconds = std::chrono::duration<double>(now - pGovernor->windowStart).count();
+            const unsigned long long records = pGovernor->records.exchange(0);
+            const unsigned long long bytes = pGovernor->bytes.exchange(0);
+            const double bytesPerSecond = bytes / seconds;
+            const double shedPerSecond = pGovernor->shedRecords.exchange(0) / seconds;
+            if(records > 0) {
+                pGovernor->recordSize = static_cast<double>(bytes) / records;
+            }
+            pGovernor->windowStart = now;
+            
+            std::vector<unsigned>& latencies = pGovernor->latencies;
+            unsigned p99 = 0;
+            if(!latencies.empty())
+            {
+                std::nth_element(latencies.begin(), latencies.begin() + latencies.size() * 99 / 100, latencies.end());
+                p99 = latencies[latencies.size() * 99 / 100];
+                latencies.clear();
+            }
+            
+            size_t backlog = 0;
+            {
+                std::lock_guard<std::mutex> asyncLk(m_asyncMutex);
+                if(m_pAsync) backlog = m_pAsync->recordCount;
+            }
+            
+            const bool over = (config.maxLatencyUs && p99 > config.maxLatencyUs) || (config.maxBytesPerSecond && bytesPerSecond > config.maxBytesPerSecond) ||
+                              (config.maxBacklog && backlog > config.maxBacklog);
+            
+            //Shed statements would be logged again after a restore, their load is counted in
+            const double restoredBytesPerSecond = bytesPerSecond + shedPerSecond * pGovernor->recordSize;
+            const bool calm = (!config.maxLatencyUs || p99 * 2 < config.maxLatencyUs) && (!config.maxBacklog || backlog * 2 < config.maxBacklog) &&
+                              (!config.maxBytesPerSecond || restoredBytesPerSecond * 2 < config.maxBytesPerSecond);
+            pGovernor->calmWindows = calm ? pGovernor->calmWindows + 1 : 0;
+            
+            const int shedLevel = m_shedLevel.load();
+            Level newLevel;
+            if(over && shedLevel > LOG_LEVEL_WARNING)
+            {
+                newLevel = shedLevel > LOG_LEVEL_NORMAL ? LOG_LEVEL_NORMAL : LOG_LEVEL_WARNING;
+                pGovernor->sheds++;
+                transition << "Load governor sheds " << (newLevel == LOG_LEVEL_NORMAL ? "DEBUG" : "NORMAL") << " records";
+            }
+            else if(shedLevel < LOG_LEVEL_INSANE && pGovernor->calmWindows >= config.restoreWindows)
+            {
+                newLevel = shedLevel < LOG_LEVEL_NORMAL ? LOG_LEVEL_NORMAL : LOG_LEVEL_INSANE;
+                pGovernor->restores++;
+                pGovernor->calmWindows = 0;
+                transition << "Load governor restores " << (newLevel == LOG_LEVEL_NORMAL ? "NORMAL" : "DEBUG") << " records";
+            }
+            else
+            {
+                return;
+            }
+            m_shedLevel = newLevel;
+            transition << " (p99 latency " << p99 << " us, " << static_cast<unsigned long long>(bytesPerSecond) << " bytes/s, "
+                       << static_cast<unsigned long long>(shedPerSecond) << " shed records/s, backlog " << backlog << ")";
+        }
+        
+        //Written after the governor is unlocked, the record is not counted in the next window
+        emitRecord(LOG_LEVEL_WARNING, transition.str());
+    }
+    
+    //Asynchronous logging implementations
+    
+    void Logger::setAsyncLogging( bool async )
+    {
+        m_asyncLogging.store(async, std::memory_order_relaxed);
+    }
+    
+    bool Logger::isAsyncLogging( ) const
+    {
+        return m_asyncLogging.load(std::memory_order_relaxed);
+    }
+    
+    bool Logger::post(const Level& level, const std::string& message)
+    {
+        if(!isLevelLogged(level, nullptr)) {
+            return false;
+        }
+        if(level > m_shedLevel.load(std::memory_order_relaxed))
+        {
+            shedRecord();
+            return false;
+        }
+        if(m_pRing)
+        {
+            //Pushing to the ring does not block either
+            pushRing(level, message);
+            return true;
+        }
+        
+        AsyncRequest request;
+        request.level = level;
+        request.header = getRecordHeader(std::chrono::system_clock::now(), getThreadIDString(), level);
+        request.message = message;
+        request.record = true;
+        request.sync = false;
+        return enqueueAsync(request, true);
+    }
+    
+    void Logger::writeAsync(const Level& level, const std::string& message, const Completion& completion, const Executor& executor)
+    {
+        AsyncRequest request;
+        request.level = level;
+        request.record = isLogged(level);
+        if(request.record)
+        {
+            request.header = getRecordHeader(std::chrono::system_clock::now(), getThreadIDString(), level);
+            request.message = message;
+        }
+        request.sync = true;
+        request.completion = completion;
+        request.executor = executor;
+        enqueueAsync(request, false);
+    }
+    
+    void Logger::flushAsync(const Completion& completion, const Executor& executor)
+    {
+        AsyncRequest request;
+        request.level = LOG_LEVEL_NORMAL;
+        request.record = false;
+        request.sync = true;
+        request.completion = completion;
+        request.executor = executor;
+        enqueueAsync(request, false);
+    }
+    
+    void Logger::setAsyncQueueCapacity( size_t capacity )
+    {
+        std::lock_guard<std::mutex> lk(m_asyncMutex);
+        m_asyncCapacity = capacity;
+    }
+    
+    unsigned long long Logger::getAsyncDroppedCount()
+    {
+        std::lock_guard<std::mutex> lk(m_asyncMutex);
+        return m_asyncDropped;
+    }
+    
+    bool Logger::enqueueAsync(AsyncRequest& request, bool dropIfFull)
+    {
+        std::lock_guard<std::mutex> lk(m_asyncMutex);
+        if(dropIfFull)
+        {
+            if(m_pAsync ? m_pAsync->recordCount >= m_asyncCapacity : m_asyncCapacity == 0)
+            {
+                m_asyncDropped++;
+                return false;
+            }
+        }
+        
+        if(!m_pAsync)
+        {
+            m_pAsync = new AsyncWriter();
+            m_pAsync->thread = std::thread(&Logger::asyncWriterThread, this);
+        }
+        
+        m_pAsync->queue.push_back(std::move(request));
+        if(dropIfFull) {
+            m_pAsync->recordCount++;
+        }
+        m_pAsync->cond.notify_one();
+        return true;
+    }
+    
+    void Logger::asyncWriterThread()
+    {
+        std::unique_lock<std::mutex> lk(m_asyncMutex);
+        AsyncWriter* const pWriter = m_pAsync;
+        while(true)
+        {
+            pWriter->cond.wait(lk, [pWriter]() { return pWriter->stop || !pWriter->queue.empty(); });
+            if(pWriter->queue.empty()) {
+                break; //Stopped and drained
+            }
+            
+            //Callers only wait for the queue mutex, never for the file. Records of the batch stay counted until they are written.
+            std::deque<AsyncRequest> batch;
+            batch.swap(pWriter->queue);
+            const size_t batchRecords = pWriter->recordCount;
+            lk.unlock();
+            
+            if(!writeAsyncBatch(pWriter, batch))
+            {
+                //A completion destroyed the logger, which detached this thread
+                delete pWriter;
+                return;
+            }
+            
+            lk.lock();
+            pWriter->recordCount -= batchRecords;
+        }
+    }
+    
+    bool Logger::writeAsyncBatch(AsyncWriter* pWriter, std::deque<AsyncRequest>& batch)
+    {
+        bool sync = false;
+        for(size_t i=0; i < batch.size(); i++)
+        {
+            const AsyncRequest& request = batch[i];
+            if(request.record)
+            {
+                if(m_pRing) pushRing(request.level, request.message);
+                else writeRecord(request.level, request.header, request.message);
+            }
+            sync = sync || request.sync;
+        }
+        
+        //One sync covers all records of the batch
+        const Result res = (sync && !m_pRing) ? syncFile() : RES_OK;
+        
+        //The logger must not be used from here on, a completion may drop its last reference
+        for(size_t i=0; i < batch.size(); i++)
+        {
+            const AsyncRequest& request = batch[i];
+            if(!request.completion) {
+                continue;
+            }
+            if(request.executor)
+            {
+                const Completion completion = request.completion;
+                request.executor([completion, res]() { completion(res); });
+            }
+            else
+            {
+                request.completion(res);
+            }
+        }
+        return !pWriter->orphaned;
+    }
+    
+    void Logger::stopAsync()
+    {
+        AsyncWriter* pWriter;
+        {
+            std::lock_guard<std::mutex> lk(m_asyncMutex);
+            pWriter = m_pAsync;
+            if(!pWriter) {
+                return;
+            }
+            m_pAsync = nullptr;
+            
+            if(pWriter->thread.get_id() != std::this_thread::get_id())
+            {
+                pWriter->stop = true;
+                pWriter->cond.notify_one();
+            }
+            else
+            {
+                //Destroyed by a completion on the I/O thread, which cannot join itself. It frees the writer when the completion returns.
+                pWriter->orphaned = true;
+                pWriter->thread.detach();
+            }
+        }
+        
+        if(!pWriter->orphaned)
+        {
+            pWriter->thread.join();
+            delete pWriter;
+            return;
+        }
+        
+        //The remaining requests are done here, the I/O thread does not come back to the queue
+        std::deque<AsyncRequest> batch;
+        batch.swap(pWriter->queue);
+        writeAsyncBatch(pWriter, batch);
+    }
+    
+    /**
+     * @brief                       Flushes the written data of a file to the disk. Any descriptor of the file syncs the data written through the others.
+     * @param   path                Path to the file.
+     * @return                      true if successful.
+     */
+    static bool syncPath(const std::string& path)
+    {
+#ifdef _MSC_VER
+        const int fd = _open(path.c_str(), _O_WRONLY | _O_APPEND);
+        if(fd < 0) {
+            return false;
+        }
+        const bool synced = _commit(fd) == 0;
+        _close(fd);
+#else
+        const int fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        if(fd < 0) {
+            return false;
+        }
+        const bool synced = fsync(fd) == 0;
+        ::close(fd);
+#endif
+        return synced;
+    }
+    
+    Logger::Result Logger::syncFile()
+    {
+        std::lock_guard<std::recursive_mutex> lk(m_logMutex);
+        if(m_path.empty())
+        {
+            std::cout.flush();
+            std::cerr.flush();
+            return RES_OK;
+        }
+        
+        //Records are flushed to the file by writeRecord
+        return syncPath(m_path) ? RES_OK : RES_FILE_ERROR;
+    }
+    
+    //Asynchronous rotation implementations
+    
+    /**
+     * @brief                       Creates an empty file and opens it for appending.
+     * @param   path                Path to the file, an existing file is replaced.
+     * @param   preallocateSize     Number of bytes to reserve on the disk, the size of the file is not changed.
+     * @return                      The open file, null if it cannot be created.
+     */
+    static std::fstream* openNextFile(const std::string& path, size_t preallocateSize)
+    {
+        //A file left by a process which exited without stopping the rotation thread
+        remove(path.c_str());
+        std::fstream* pFile = new std::fstream(path.c_str(), std::ios::out | std::ios::app);
+        if(!pFile->is_open())
+        {
+            delete pFile;
+            return nullptr;
+        }
+#ifdef __linux__
+        //Appends up to the maximum size do not allocate blocks then
+        const int fd = ::open(path.c_str(), O_WRONLY);
+        if(fd >= 0)
+        {
+            (void)fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(preallocateSize));
+            ::close(fd);
+        }
+#else
+        (void)preallocateSize;
+#endif
+        return pFile;
+    }
+    
+    void Logger::setAsyncRotation( bool async, bool syncRotated )
+    {
+#ifndef _MSC_VER
+        std::lock_guard<std::recursive_mutex> lk(m_logMutex);
+        if(m_overflowAction != ACTION_ROTATE || m_path.empty() || m_pShared || m_pRing) {
+            return;
+        }
+        
+        if(!async)
+        {
+            stopRotation();
+            return;
+        }
+        
+        if(!m_pRotation)
+        {
+            m_pRotation = new RotationWorker();
+            m_pRotation->nextPath = m_path + ".next";
+            m_pRotation->preallocateSize = m_maxLogSize;
+            m_pRotation->thread = std::thread(&Logger::rotationThread, m_pRotation);
+        }
+        std::lock_guard<std::mutex> rotationLk(m_pRotation->mutex);
+        m_pRotation->syncRotated = syncRotated;
+#else
+        (void)async;
+        (void)syncRotated;
+#endif
+    }
+    
+    bool Logger::rotateToNextFile(const std::string& rotatedPath)
+    {
+        std::fstream* pNext;
+        {
+            std::lock_guard<std::mutex> lk(m_pRotation->mutex);
+            pNext = m_pRotation->pNext;
+            m_pRotation->pNext = nullptr;
+        }
+        if(!pNext) {
+            return false;
+        }
+        
+        //Only names change here, the data of the old file is not touched
+        std::fstream* pOld = (std::fstream*)m_pFile;
+        const bool renamed = rename(m_path.c_str(), rotatedPath.c_str()) == 0 && rename(m_pRotation->nextPath.c_str(), m_path.c_str()) == 0;
+        if(renamed)
+        {
+            m_pFile = pNext;
+            rememberFileIdentity();
+        }
+        
+        {
+            std::lock_guard<std::mutex> lk(m_pRotation->mutex);
+            m_pRotation->retired.push_back(std::make_pair(renamed ? pOld : pNext, renamed ? rotatedPath : m_pRotation->nextPath));
+        }
+        m_pRotation->cond.notify_one();
+        
+        //The cache entry of an open old file is taken over by the next file
+        if(renamed && !m_fileCached) {
+            cacheFile();
+        }
+        return renamed;
+    }
+    
+    void Logger::stopRotation()
+    {
+        if(!m_pRotation) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(m_pRotation->mutex);
+            m_pRotation->stop = true;
+            m_pRotation->cond.notify_one();
+        }
+        
+        m_pRotation->thread.join();
+        delete m_pRotation;
+        m_pRotation = nullptr;
+    }
+    
+    void Logger::rotationThread(RotationWorker* pWorker)
+    {
+#ifdef __linux__
+        //Woken up by the writer at the rotation, it should not take the CPU of the writer
+        (void)setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#endif
+        std::unique_lock<std::mutex> lk(pWorker->mutex);
+        while(true)
+        {
+            while(!pWorker->retired.empty())
+            {
+                const std::pair<std::fstream*, std::string> file = pWorker->retired.back();
+                pWorker->retired.pop_back();
+                const bool sync = pWorker->syncRotated;
+                lk.unlock();
+                
+                file.first->close();
+                if(sync) {
+                    syncPath(file.second);
+                }
+                delete file.first;
+                lk.lock();
+            }
+            if(pWorker->stop) {
+                break;
+            }
+            
+            if(!pWorker->pNext)
+            {
+                const std::string nextPath = pWorker->nextPath;
+                const size_t preallocateSize = pWorker->preallocateSize;
+                lk.unlock();
+                std::fstream* pNext = openNextFile(nextPath, preallocateSize);
+                lk.lock();
+                pWorker->pNext = pNext;
+            }
+            
+            //Woken up by rotations, retried periodically if the next file cannot be created
+            pWorker->cond.wait_for(lk, std::chrono::seconds(1), [pWorker]() { return pWorker->stop || !pWorker->retired.empty(); });
+        }
+        
+        if(pWorker->pNext)
+        {
+            delete pWorker->pNext;
+            pWorker->pNext = nullptr;
+            remove(pWorker->nextPath.c_str());
+        }
+    }
+    
+    //Multi-process shared file implementations
+    
+    //Records being written by one process, so that the count of a crashed process can be told apart and cleared
+    struct SharedWriterSlot
+    {
+        std::atomic<int32_t>    pid;            ///< Owner process, 0 if the slot is free
+        std::atomic<int32_t>    writers;        ///< Records being written by the owner
+    };
+    
+    //Layout of the memory mapped control file. Writers only touch the atomics, maintenance is serialized with flock on the control file.
+    struct SharedHeader
+    {
+        uint32_t                magic;          ///< RW_SHARED_MAGIC once initialized
+        uint32_t                reserved;
+        std::atomic<uint64_t>   size;           ///< Approximate size of the log file, grows with each record
+        std::atomic<uint64_t>   generation;     ///< Incremented before and after each truncation/rotation, odd while it is in progress
+        SharedWriterSlot        slots[RW_SHARED_MAX_PROCESSES];
+    };
+    
+    struct Logger::SharedFile
+    {
+        int             fd;                     ///< Log file opened with O_APPEND
+        int             controlFd;              ///< Control file, also used as the lock. A forked child reopens it, the inherited descriptor shares the lock of the parent.
+        SharedHeader    *pHeader;               ///< Mapped control file
+        uint64_t        generation;             ///< Generation fd was opened at
+        SharedWriterSlot *pSlot;                ///< Slot of this process, null if none is free
+        int             pid;                    ///< Process pSlot was claimed for, a forked child claims its own
+        std::chrono::steady_clock::time_point retryTime;   ///< Maintenance skipped because of a stalled writer is not tried before this
+    };
+    
+#ifndef _MSC_VER
+    size_t Logger::getSharedLogSize() const
+    {
+        return static_cast<size_t>(m_pShared->pHeader->size.load(std::memory_order_relaxed));
+    }
+    
+    /**
+     * @brief                       Checks whether a process which shares a file or a ring still runs.
+     * @param   pid                 Process id taken from the shared memory.
+     * @return                      false if the process is gone.
+     */
+    static bool isProcessAlive(int64_t pid)
+    {
+        //EPERM means the process exists but belongs to another user
+        return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+    }
+    
+    /**
+     * @brief                       Takes a free writer slot for the calling process. The control file lock must be held.
+     * @param   pHeader             Mapped control file.
+     * @return                      The slot, null if all slots are used by running processes.
+     */
+    static SharedWriterSlot* claimSharedSlot(SharedHeader* pHeader)
+    {
+        //Slots of crashed processes are taken over, their counts are cleared
+        const pid_t pid = getpid();
+        for(size_t i=0; i < RW_SHARED_MAX_PROCESSES; i++)
+        {
+            SharedWriterSlot& slot = pHeader->slots[i];
+            const pid_t owner = slot.pid.load();
+            if(owner == 0 || !isProcessAlive(owner))
+            {
+                slot.writers.store(0);
+                slot.pid.store(pid);
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+    
+    /**
+     * @brief                       Checks whether records are being written to a shared file and clears the counts of crashed processes.
+     * @param   pHeader             Mapped control file.
+     * @return                      true if no running process is writing a record.
+     */
+    static bool drainSharedWriters(SharedHeader* pHeader)
+    {
+        bool drained = true;
+        for(size_t i=0; i < RW_SHARED_MAX_PROCESSES; i++)
+        {
+            SharedWriterSlot& slot = pHeader->slots[i];
+            const pid_t owner = slot.pid.load();
+            if(owner == 0 || slot.writers.load() <= 0) {
+                continue;
+            }
+            if(isProcessAlive(owner))
+            {
+                drained = false;
+            }
+            else
+            {
+                slot.writers.store(0);
+                slot.pid.store(0);
+            }
+        }
+        return drained;
+    }
+    
+    Logger::Result Logger::openShared()
+    {
+        const std::string controlPath = m_path + ".ctl";
+        const int controlFd = ::open(controlPath.c_str(), O_RDWR | O_CREAT, 0644);
+        if(controlFd < 0) {
+            return RES_FILE_ERROR;
+        }
+        
+        flock(controlFd, LOCK_EX);
+        struct stat st;
+        if(fstat(controlFd, &st) != 0 || (static_cast<size_t>(st.st_size) < sizeof(SharedHeader) && ftruncate(controlFd, sizeof(SharedHeader)) != 0))
+        {
+            flock(controlFd, LOCK_UN);
+            ::close(controlFd);
+            return RES_FILE_ERROR;
+        }
+        
+        void* pMap = mmap(nullptr, sizeof(SharedHeader), PROT_READ | PROT_WRITE, MAP_SHARED, controlFd, 0);
+        if(pMap == MAP_FAILED)
+        {
+            flock(controlFd, LOCK_UN);
+            ::close(controlFd);
+            return RES_FILE_ERROR;
+        }
+        
+        SharedHeader* pHeader = static_cast<SharedHeader*>(pMap);
+        if(pHeader->magic != RW_SHARED_MAGIC)
+        {
+            //First user of the file, the only time the log file is checked
+            struct stat logStat;
+            pHeader->size.store(stat(m_path.c_str(), &logStat) == 0 ? static_cast<uint64_t>(logStat.st_size) : 0);
+            pHeader->generation.store(0);
+            for(size_t i=0; i < RW_SHARED_MAX_PROCESSES; i++)
+            {
+                pHeader->slots[i].pid.store(0);
+                pHeader->slots[i].writers.store(0);
+            }
+            pHeader->magic = RW_SHARED_MAGIC;
+        }
+        SharedWriterSlot* pSlot = claimSharedSlot(pHeader);
+        flock(controlFd, LOCK_UN);
+        
+        SharedFile* pShared = pSlot ? new (std::nothrow) SharedFile : nullptr;
+        if(!pShared)
+        {
+            if(pSlot) pSlot->pid.store(0);
+            munmap(pMap, sizeof(SharedHeader));
+            ::close(controlFd);
+            return pSlot ? RES_MEMORY_ERROR : RES_ERROR;
+        }
+        pShared->fd = -1;
+        pShared->controlFd = controlFd;
+        pShared->pHeader = pHeader;
+        pShared->generation = 0;
+        pShared->pSlot = pSlot;
+        pShared->pid = getpid();
+        m_pShared = pShared;
+        return RES_OK;
+    }
+    
+    void Logger::closeShared()
+    {
+        if(!m_pShared) return;
+        
+        if(m_pShared->fd >= 0) ::close(m_pShared->fd);
+        //A forked child which did not log leaves the slot to its parent
+        if(m_pShared->pSlot && m_pShared->pid == getpid()) m_pShared->pSlot->pid.store(0);
+        munmap(m_pShared->pHeader, sizeof(SharedHeader));
+        if(m_pShared->controlFd >= 0) ::close(m_pShared->controlFd);
+        delete m_pShared;
+        m_pShared = nullptr;
+    }
+    
+    void Logger::writeShared(const std::string& header, const std::string& message)
+    {
+        SharedHeader* pHeader = m_pShared->pHeader;
+        
+        //A child forked after the logger was created counts its records in its own slot
+        const pid_t pid = getpid();
+        if(m_pShared->pid != pid)
+        {
+            //flock belongs to the open file description shared with the parent, the child needs its own to exclude it
+            if(m_pShared->controlFd >= 0) ::close(m_pShared->controlFd);
+            m_pShared->controlFd = ::open((m_path + ".ctl").c_str(), O_RDWR);
+            if(m_pShared->controlFd < 0)
+            {
+                m_writeErrors.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            flock(m_pShared->controlFd, LOCK_EX);
+            SharedWriterSlot* pSlot = claimSharedSlot(pHeader);
+            flock(m_pShared->controlFd, LOCK_UN);
+            if(!pSlot)
+            {
+                m_writeErrors.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            m_pShared->pSlot = pSlot;
+            m_pShared->pid = pid;
+        }
+        std::atomic<int32_t>& writers = m_pShared->pSlot->writers;
+        
+        //Split the message so that each line fits into one atomic write
+        const size_t maxBody = RW_SHARED_MAX_RECORD > header.size() + 2 ? RW_SHARED_MAX_RECORD - header.size() - 1 : 1;
+        size_t offset = 0;
+        uint64_t written = 0;
+        do
+        {
+            const size_t bodyLen = std::min(maxBody, message.size() - offset);
+            std::string line;
+            line.reserve(header.size() + bodyLen + 2);
+            if(m_tornRecord) line.push_back('\n');
+            line.append(header).append(message, offset, bodyLen).push_back('\n');
+            offset += bodyLen;
+            
+            //Announce the write before checking the generation, maintenance announces itself before checking the writers
+            for(;;)
+            {
+                writers.fetch_add(1);
+                const uint64_t generation = pHeader->generation.load();
+                if((generation & 1) == 0) {
+                    if(generation != m_pShared->generation || m_pShared->fd < 0)
+                    {
+                        //Another process truncated or rotated the file
+                        if(m_pShared->fd >= 0) ::close(m_pShared->fd);
+                        m_pShared->fd = ::open(m_path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+                        m_pShared->generation = generation;
+                    }
+                    break;
+                }
+                //Maintenance in progress, wait for its lock
+                writers.fetch_sub(1);
+                flock(m_pShared->controlFd, LOCK_SH);
+                flock(m_pShared->controlFd, LOCK_UN);
+            }
+            
+            if(m_pShared->fd >= 0)
+            {
+                const int fd = m_pShared->fd;
+                const size_t lineWritten = writeFile(line.data(), line.size(), [fd](const char* p, size_t n) -> long {
+                    return static_cast<long>(::write(fd, p, n));
+                });
+                m_tornRecord = lineWritten < line.size();
+                written += lineWritten;
+            }
+            writers.fetch_sub(1);
+        }
+        while(offset < message.size());
+        
+        const uint64_t size = pHeader->size.fetch_add(written, std::memory_order_relaxed) + written;
+        if(m_overflowAction != ACTION_NONE && size > m_maxLogSize && std::chrono::steady_clock::now() >= m_pShared->retryTime)
+        {
+            maintainShared();
+        }
+    }
+    
+    void Logger::maintainShared()
+    {
+        SharedHeader* pHeader = m_pShared->pHeader;
+        
+        flock(m_pShared->controlFd, LOCK_EX);
+        if(pHeader->size.load() > m_maxLogSize)
+        {
+            pHeader->generation.fetch_add(1);
+            
+            //Wait for the records in progress. Counts left by crashed processes are cleared, live writers are never cut off.
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(RW_SHARED_DRAIN_TIMEOUT_MS);
+            while(!drainSharedWriters(pHeader))
+            {
+                if(std::chrono::steady_clock::now() > deadline)
+                {
+                    //A stalled writer, e.g. a stopped process, the file is left as is and maintenance is retried later
+                    pHeader->generation.fetch_add(1);
+                    flock(m_pShared->controlFd, LOCK_UN);
+                    m_pShared->retryTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(RW_SHARED_DRAIN_TIMEOUT_MS);
+                    return;
+                }
+                std::this_thread::yield();
+            }
+            
+            if(m_pShared->fd >= 0) {
+                ::close(m_pShared->fd);
+                m_pShared->fd = -1;
+            }
+            
+            if(m_overflowAction == ACTION_TRUNCATE)
+            {
+                //The shared size is an estimate, a failed write of another process or a replaced file leaves the file shorter.
+                //It is only cut if it is really longer than the part which is kept.
+                struct stat st;
+                const size_t keep = std::max<size_t>(m_maxLogSize/2, RW_MIN_LOG_LENGTH);
+                if(stat(m_path.c_str(), &st) == 0 && static_cast<uint64_t>(st.st_size) > keep) {
+                    truncate(keep);
+                }
+                pHeader->size.store(stat(m_path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0);
+            }
+            if(m_overflowAction == ACTION_ROTATE)
+            {
+                rotate();
+                pHeader->size.store(0);
+            }
+            
+            pHeader->generation.fetch_add(1);
+        }
+        flock(m_pShared->controlFd, LOCK_UN);
+    }
+#else
+    size_t Logger::getSharedLogSize() const
+    {
+        return 0;
+    }
+    
+    Logger::Result Logger::openShared()
+    {
+        return RES_ERROR;
+    }
+    
+    void Logger::closeShared()
+    {
+    }
+    
+    void Logger::writeShared(const std::string&, const std::string&)
+    {
+    }
+    
+    void Logger::maintainShared()
+    {
+    }
+#endif
+    
+    //Shared memory ring implementations
+    
+    //Layout of the ring file: RingHeader followed by slotCount slots of slotSize bytes, each slot starts with RingSlot followed by the message.
+    //Producers and the daemon synchronize through the sequence of the slots (bounded queue of Dmitry Vyukov), nothing is locked while logging.
+    struct RingHeader
+    {
+        uint32_t                magic;              ///< RW_RING_MAGIC once initialized
+        uint32_t                slotCount;          ///< Power of two
+        uint32_t                slotSize;           ///< Multiple of 64
+        uint32_t                reserved;
+        std::atomic<uint64_t>   head;               ///< Next position to be claimed by producers
+        std::atomic<uint64_t>   tail;               ///< Next position to be consumed by the daemon, kept for a restarted daemon
+        std::atomic<uint64_t>   dropped;            ///< Records dropped because the ring was full
+        std::atomic<uint64_t>   droppedReported;    ///< Dropped records already reported in the log file
+        std::atomic<uint64_t>   cut;                ///< Messages cut to the slot size
+        std::atomic<uint64_t>   abandoned;          ///< Slots skipped because their producer crashed or did not publish in time
+        std::atomic<int64_t>    daemonPid;          ///< Pid of the serving daemon, 0 if none
+        char                    padding[56];
+    };
+    
+    struct RingSlot
+    {
+        std::atomic<uint64_t>   sequence;           ///< Position the slot is free for, position + 1 once the record is published, position | RW_RING_ABANDONED once skipped
+        std::atomic<int64_t>    pid;                ///< Producer which claimed the slot, 0 if unknown
+        int64_t                 time;               ///< Microseconds since epoch
+        int32_t                 level;
+        uint32_t                length;
+        char                    threadId[24];
+    };
+    
+    struct Logger::RingTransport
+    {
+        int             fd;
+        RingHeader      *pHeader;
+        size_t          mappedSize;
+        int64_t         pid;                        ///< Pid of the process which mapped the ring
+    };
+    
+    static RingSlot* getRingSlot(RingHeader* pHeader, uint64_t position)
+    {
+        char* pSlots = reinterpret_cast<char*>(pHeader) + sizeof(RingHeader);
+        return reinterpret_cast<RingSlot*>(pSlots + (position & (pHeader->slotCount - 1)) * pHeader->slotSize);
+    }
+    
+#ifndef _MSC_VER
+    Logger::Result Logger::openRing(size_t slotCount, size_t slotSize)
+    {
+        const std::string ringPath = m_path + ".ring";
+        const int fd = ::open(ringPath.c_str(), O_RDWR | O_CREAT, 0644);
+        if(fd < 0) {
+            return RES_FILE_ERROR;
+        }
+        
+        //Producers and the daemon hold the shared lock while the ring is mapped, so that removeRing does not remove a ring in use.
+        //Only a file which is not a ring yet is initialized under the exclusive lock.
+        flock(fd, LOCK_SH);
+        uint32_t geometry[3] = { 0, 0, 0 };
+        bool valid = pread(fd, geometry, sizeof(geometry), 0) == static_cast<ssize_t>(sizeof(geometry)) && geometry[0] == RW_RING_MAGIC;
+        const bool exclusive = !valid;
+        if(exclusive)
+        {
+            flock(fd, LOCK_EX);
+            valid = pread(fd, geometry, sizeof(geometry), 0) == static_cast<ssize_t>(sizeof(geometry)) && geometry[0] == RW_RING_MAGIC;
+        }
+        const bool initialize = !valid;
+        
+        size_t count = 2;
+        size_t size = std::max(slotSize, sizeof(RingSlot) + 64);
+        if(valid)
+        {
+            count = geometry[1];
+            size = geometry[2];
+        }
+        else
+        {
+            while(count < slotCount) count <<= 1;
+            size = (size + 63) & ~size_t(63);
+        }
+        const size_t mappedSize = sizeof(RingHeader) + count * size;
+        
+        //A file which is not a ring (or a ring of an older layout) is reinitialized
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        if(ok && initialize) ok = ftruncate(fd, 0) == 0 && ftruncate(fd, mappedSize) == 0;
+        if(ok && !initialize) ok = static_cast<size_t>(st.st_size) >= mappedSize;
+        
+        void* pMap = ok ? mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        if(pMap == MAP_FAILED)
+        {
+            flock(fd, LOCK_UN);
+            ::close(fd);
+            return RES_FILE_ERROR;
+        }
+        
+        RingHeader* pHeader = static_cast<RingHeader*>(pMap);
+        if(initialize)
+        {
+            pHeader->slotCount = static_cast<uint32_t>(count);
+            pHeader->slotSize = static_cast<uint32_t>(size);
+            for(uint64_t i = 0; i < count; ++i) {
+                getRingSlot(pHeader, i)->sequence.store(i);
+            }
+            pHeader->magic = RW_RING_MAGIC;
+        }
+        if(exclusive) {
+            //The conversion is not atomic, a ring removed in between is opened again
+            flock(fd, LOCK_SH);
+        }
+        if(fstat(fd, &st) == 0 && st.st_nlink == 0)
+        {
+            munmap(pMap, mappedSize);
+            ::close(fd);
+            return openRing(slotCount, slotSize);
+        }
+        
+        RingTransport* pRing = new (std::nothrow) RingTransport;
+        if(!pRing)
+        {
+            munmap(pMap, mappedSize);
+            ::close(fd);
+            return RES_MEMORY_ERROR;
+        }
+        pRing->fd = fd;
+        pRing->pHeader = pHeader;
+        pRing->mappedSize = mappedSize;
+        pRing->pid = getpid();
+        m_pRing = pRing;
+        return RES_OK;
+    }
+    
+    void Logger::closeRing()
+    {
+        if(!m_pRing) return;
+        
+        munmap(m_pRing->pHeader, m_pRing->mappedSize);
+        ::close(m_pRing->fd);
+        delete m_pRing;
+        m_pRing = nullptr;
+    }
+    
+    void Logger::pushRing(const Level& level, const std::string& message)
+    {
+        RingHeader* pHeader = m_pRing->pHeader;
+        
+        uint64_t position = pHeader->head.load(std::memory_order_relaxed);
+        RingSlot* pSlot = nullptr;
+        for(;;)
+        {
+            pSlot = getRingSlot(pHeader, position);
+            const uint64_t sequence = pSlot->sequence.load(std::memory_order_acquire);
+            const int64_t diff = static_cast<int64_t>(sequence - position);
+            if(diff == 0)
+            {
+                if(pHeader->head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            else if(diff < 0)
+            {
+                //Full, the daemon is behind or not running
+                pHeader->dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else
+            {
+                position = pHeader->head.load(std::memory_order_relaxed);
+            }
+        }
+        
+        pSlot->pid.store(m_pRing->pid, std::memory_order_relaxed);
+        pSlot->time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        pSlot->level = level;
+        
+        const std::string& threadId = getThreadIDString();
+        std::memset(pSlot->threadId, 0, sizeof(pSlot->threadId));
+        std::memcpy(pSlot->threadId, threadId.data(), std::min(threadId.size(), sizeof(pSlot->threadId)));
+        
+        const size_t capacity = pHeader->slotSize - sizeof(RingSlot);
+        const size_t length = std::min(message.size(), capacity);
+        if(length < message.size()) pHeader->cut.fetch_add(1, std::memory_order_relaxed);
+        std::memcpy(reinterpret_cast<char*>(pSlot) + sizeof(RingSlot), message.data(), length);
+        pSlot->length = static_cast<uint32_t>(length);
+        
+        //Fails only if the daemon gave up waiting for this slot. The slot is left to the next lap only now that the copy is done.
+        uint64_t expected = position;
+        if(!pSlot->sequence.compare_exchange_strong(expected, position + 1, std::memory_order_release, std::memory_order_relaxed)) {
+            pSlot->sequence.store(position + pHeader->slotCount, std::memory_order_release);
+        }
+    }
+    
+    Logger::Result Logger::serveRing(const std::string& filePath, const OverflowAction& overflowAction, size_t maxLogSize, const std::atomic<bool>& stop)
+    {
+        Logger ring(filePath, ACTION_NONE);
+        const Result res = ring.openRing(4096, 512);
+        if(res != RES_OK) {
+            return res;
+        }
+        RingHeader* pHeader = ring.m_pRing->pHeader;
+        
+        //Take over the ring unless another daemon is alive
+        const int64_t self = getpid();
+        int64_t owner = pHeader->daemonPid.load();
+        if(owner != 0 && owner != self && isProcessAlive(owner)) {
+            return RES_ERROR;
+        }
+        if(!pHeader->daemonPid.compare_exchange_strong(owner, self)) {
+            return RES_ERROR;
+        }
+        
+        Logger fileLogger(filePath, overflowAction);
+        fileLogger.setMaxLogSize(maxLogSize);
+        
+        const size_t capacity = pHeader->slotSize - sizeof(RingSlot);
+        uint64_t position = pHeader->tail.load();
+        bool waiting = false;
+        std::chrono::steady_clock::time_point waitingSince;
+        bool stopping = false;
+        uint64_t stopPosition = 0;
+        
+        for(;;)
+        {
+            //Under steady load a published record is always waiting, once stopped only the records claimed before are drained
+            if(stop.load(std::memory_order_relaxed))
+            {
+                if(!stopping)
+                {
+                    stopping = true;
+                    stopPosition = pHeader->head.load();
+                }
+                if(static_cast<int64_t>(position - stopPosition) >= 0) {
+                    break;
+                }
+            }
+            
+            RingSlot* pSlot = getRingSlot(pHeader, position);
+            const uint64_t sequence = pSlot->sequence.load(std::memory_order_acquire);
+            if(sequence == position + 1)
+            {
+                const char* pMessage = reinterpret_cast<const char*>(pSlot) + sizeof(RingSlot);
+                const std::string message(pMessage, std::min<size_t>(pSlot->length, capacity));
+                const std::string threadId(pSlot->threadId, std::find(pSlot->threadId, pSlot->threadId + sizeof(pSlot->threadId), '\0'));
+                const std::chrono::system_clock::time_point time = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(pSlot->time)));
+                const Level level = static_cast<Level>(pSlot->level);
+                
+                //The slot is released after the write, a daemon which stops in between writes the record again after a restart
+                fileLogger.writeRecord(level, getRecordHeader(time, threadId, level), message);
+                pSlot->pid.store(0, std::memory_order_relaxed);
+                pSlot->sequence.store(position + pHeader->slotCount, std::memory_order_release);
+                pHeader->tail.store(++position);
+                waiting = false;
+                continue;
+            }
+            if(sequence == (position | RW_RING_ABANDONED) || ((sequence & RW_RING_ABANDONED) == 0 && static_cast<int64_t>(sequence - position) > 1))
+            {
+                //Released or skipped by a previous daemon which stopped before it moved the tail
+                pHeader->tail.store(++position);
+                continue;
+            }
+            
+            if(stop.load()) {
+                break;
+            }
+            
+            //A claimed slot which is not published yet, or a slot still written by a producer skipped on the previous lap
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            const bool claimed = pHeader->head.load() != position;
+            const bool blocked = sequence == ((position - pHeader->slotCount) | RW_RING_ABANDONED);
+            if(claimed || blocked)
+            {
+                if(!waiting)
+                {
+                    waiting = true;
+                    waitingSince = now;
+                }
+                const int64_t pid = pSlot->pid.load(std::memory_order_relaxed);
+                const bool gone = pid != 0 && !isProcessAlive(pid);
+                const bool late = now - waitingSince > std::chrono::milliseconds(RW_RING_PUBLISH_TIMEOUT_MS);
+                
+                //The slot of a crashed producer is reused. A late producer may still copy its record, its slot stays blocked until it is done.
+                uint64_t next = 0;
+                if(claimed && gone) next = position + pHeader->slotCount;
+                else if(claimed && late) next = position | RW_RING_ABANDONED;
+                else if(blocked && (gone || (pid == 0 && late))) next = position;
+                
+                uint64_t expected = sequence;
+                if(next != 0 && pSlot->sequence.compare_exchange_strong(expected, next))
+                {
+                    if(claimed)
+                    {
+                        pHeader->abandoned.fetch_add(1);
+                        pHeader->tail.store(++position);
+                    }
+                    waiting = false;
+                    continue;
+                }
+            }
+            
+            const uint64_t dropped = pHeader->dropped.load(std::memory_order_relaxed);
+            const uint64_t reported = pHeader->droppedReported.load();
+            if(dropped != reported)
+            {
+                std::stringstream ss;
+                ss << "rwloggerd: " << dropped - reported << " records dropped, the ring was full";
+                fileLogger.writeRecord(LOG_LEVEL_WARNING, getRecordHeader(std::chrono::system_clock::now(), getThreadIDString(), LOG_LEVEL_WARNING), ss.str());
+                pHeader->droppedReported.store(dropped);
+            }
+            
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        
+        int64_t expectedOwner = self;
+        pHeader->daemonPid.compare_exchange_strong(expectedOwner, 0);
+        return RES_OK;
+    }
+    
+    Logger::Result Logger::removeRing(const std::string& filePath)
+    {
+        const std::string ringPath = filePath + ".ring";
+        const int fd = ::open(ringPath.c_str(), O_RDWR);
+        if(fd < 0) {
+            return RES_FILE_ERROR;
+        }
+        
+        //Producers and the daemon hold a shared lock while they map the ring, crashed ones do not
+        if(flock(fd, LOCK_EX | LOCK_NB) != 0)
+        {
+            ::close(fd);
+            return RES_ERROR;
+        }
+        
+        Result res = RES_ERROR;
+        struct stat st;
+        void* pMap = fstat(fd, &st) == 0 && st.st_size > 0 ? mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        bool pending = false;
+        if(pMap != MAP_FAILED)
+        {
+            //Only published records are pending, slots claimed by crashed producers are not
+            RingHeader* pHeader = static_cast<RingHeader*>(pMap);
+            if(static_cast<size_t>(st.st_size) >= sizeof(RingHeader) && pHeader->magic == RW_RING_MAGIC &&
+               static_cast<size_t>(st.st_size) >= sizeof(RingHeader) + static_cast<size_t>(pHeader->slotCount) * pHeader->slotSize)
+            {
+                const uint64_t head = pHeader->head.load();
+                uint64_t position = pHeader->tail.load();
+                for(uint64_t i = 0; position != head && i < pHeader->slotCount && !pending; ++position, ++i) {
+                    pending = getRingSlot(pHeader, position)->sequence.load() == position + 1;
+                }
+            }
+            munmap(pMap, static_cast<size_t>(st.st_size));
+        }
+        if(!pending && unlink(ringPath.c_str()) == 0) {
+            res = RES_OK;
+        }
+        flock(fd, LOCK_UN);
+        ::close(fd);
+        return res;
+    }
+#else
+    Logger::Result Logger::openRing(size_t, size_t)
+    {
+        return RES_ERROR;
+    }
+    
+    void Logger::closeRing()
+    {
+    }
+    
+    void Logger::pushRing(const Level&, const std::string&)
+    {
+    }
+    
+    Logger::Result Logger::serveRing(const std::string&, const OverflowAction&, size_t, const std::atomic<bool>&)
+    {
+        return RES_ERROR;
+    }
+    
+    Logger::Result Logger::removeRing(const std::string&)
+    {
+        return RES_ERROR;
+    }
+#endif
+    
+    //Manager related implementations
+    
+    const std::string Logger::defaultLoggerFilePath = "rw_default_log.txt";
+    const std::string Logger::consoleLoggerFilePath = "";
+    std::recursive_mutex Logger::m_managerMutex;
+    bool Logger::m_reclaimIdleLoggers = false;
+    size_t Logger::m_reclaimWatermark = RW_DEFAULT_MAX_OPEN_FILES;
+    //Must be defined before m_loggers, destructors of the loggers remove them from the cache
+    std::mutex Logger::m_fileCacheMutex;
+    Logger::FileCacheList Logger::m_openFiles;
+    std::atomic<size_t> Logger::m_maxOpenFiles(RW_DEFAULT_MAX_OPEN_FILES);
+    std::atomic<unsigned long long> Logger::m_fileCacheClock(0);
+    Logger::FileCacheStats Logger::m_fileCacheStats = {0, 0, 0, 0, 0};
+    Logger::LoggerContainer Logger::m_loggers;
+    
+    Logger::Result Logger::init()
+    {
+        LogPtr consoleLogger = getConsoleLogger();
+        if(consoleLogger) {
+            return RES_OK;
+        }
+        return RES_MEMORY_ERROR;
+    }
+    
+    Logger::LogPtr Logger::getConsoleLogger()
+    {
+        std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
+        const LoggerContainer::iterator it = m_loggers.find(consoleLoggerFilePath);
+        
+        LogPtr res;
+        if(it != m_loggers.end()) {
+            res = it->second;
+        }
+        else
+        {
+            Logger* pLogger = new (std::nothrow) Logger(consoleLoggerFilePath, ACTION_NONE);
+            if(pLogger) {
+                pLogger->setReflectToConsole(true);
+                res = LogPtr(pLogger);
+                m_loggers[consoleLoggerFilePath] = res;
+            }
+        }
+        return res;
+    }
+    
+    Logger::LogPtr Logger::getDefaultLogger(const Logger::OverflowAction& overflowAction)
+    {
+        std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
+        const LoggerContainer::iterator it = m_loggers.find(defaultLoggerFilePath);
+        
+        LogPtr res;
+        if(it != m_loggers.end()) {
+            res = it->second;
+        }
+        else
+        {
+            Logger* pLogger = new (std::nothrow) Logger(defaultLoggerFilePath, overflowAction);
+            if(pLogger) {
+                res = LogPtr(pLogger);
+                m_loggers[defaultLoggerFilePath] = res;
+            }
+            else
+            {
+                res = getConsoleLogger();
+            }
+        }
+        return res;
+    }
+    
+    Logger::LogPtr Logger::getFileLogger(const std::string& filePath, const Logger::OverflowAction& overflowAction)
+    {
+        //Declared before the lock, swept loggers are destroyed after it is released
+        std::vector<LogPtr> reclaimed;
+        std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
+        const LoggerContainer::iterator it = m_loggers.find(filePath);
+        
+        LogPtr res;
+        if(it != m_loggers.end()) {
+            res = it->second;
+        }
+        else
+        {
+            Logger* pLogger = new (std::nothrow) Logger(filePath, overflowAction);
+            if(pLogger) {
+                res = LogPtr(pLogger);
+                m_loggers[filePath] = res;
+                
+                //Amortized, the container is swept only after it doubles
+                if(m_reclaimIdleLoggers && m_loggers.size() > m_reclaimWatermark)
+                {
+                    takeIdleLoggers(reclaimed);
+                    m_reclaimWatermark = std::max(2*m_loggers.size(), size_t(RW_DEFAULT_MAX_OPEN_FILES));
+                }
+            }
+            else
+            {
+                res = getConsoleLogger();
+            }
+        }
+        return res;
+    }
+    
+    Logger::LogPtr Logger::getSharedFileLogger(const std::string& filePath, const Logger::OverflowAction& overflowAction)
+    {
+        std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
+        const LoggerContainer::iterator it = m_loggers.find(filePath);
+        
+        LogPtr res;
+        if(it != m_loggers.end()) {
+            res = it->second;
+        }
+        else
+        {
+            Logger* pLogger = new (std::nothrow) Logger(filePath, overflowAction);
+#ifndef _MSC_VER
+            //Writing without the control file would tear the records of the other processes
+            if(pLogger && pLogger->openShared() != RES_OK)
+            {
+                delete pLogger;
+                pLogger = nullptr;
+            }
+#endif
+            if(pLogger) {
+                //Windows has no shared mode, the logger stays a regular file logger there
+                res = LogPtr(pLogger);
+                m_loggers[filePath] = res;
+            }
+            else
+            {
+                res = getConsoleLogger();
+            }
+        }
+        return res;
+    }
+    
+    Logger::LogPtr Logger::getRingLogger(const std::string& filePath, size_t slotCount, size_t slotSize)
+    {
+        std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
+        const LoggerContainer::iterator it = m_loggers.find(filePath);
+        
+        LogPtr res;
+        if(it != m_loggers.end()) {
+            res = it->second;
+        }
+        else
+        {
+            Logger* pLogger = new (std::nothrow) Logger(filePath, ACTION_NONE);
+            if(pLogger) {
+                //If the ring cannot be mapped (or on Windows) the logger writes the file itself
+                pLogger->openRing(slotCount, slotSize);
+                res = LogPtr(pLogger);
+                m_loggers[filePath] = res;
+            }
+            else
+            {
+                res = getConsoleLogger();
+            }
+        }
+        return res;
+    }
+    
+    Logger::Result Logger::destroy(const std::string& filePath)
+    {
+        if(filePath == consoleLoggerFilePath)
+        {
+            return RES_BAD_ARGS; //Cannot remove console logger
+        }
+        if(filePath == defaultLoggerFilePath)
+        {
             return RES_BAD_ARGS; //Cannot remove default logger
         }
         
+        //Declared before the lock, the logger is destroyed after it is released if this was its last reference
+        LogPtr removed;
         std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
         const LoggerContainer::iterator it = m_loggers.find(filePath);
         if(it != m_loggers.end()) {
+            removed = std::move(it->second);
             m_loggers.erase(it);
         }
         else
@@ -392,6 +2535,453 @@ namespace rw
         std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
         return m_loggers.size();
     }
+    
+    std::mutex Logger::m_writeNotifyMutex;
+    std::condition_variable Logger::m_writeNotifyCond;
+    std::atomic<int> Logger::m_writeWaiters(0);
+    unsigned long long Logger::m_writeSequence = 0;
+    
+    void Logger::notifyWrite()
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_writeNotifyMutex);
+            m_writeSequence++;
+        }
+        m_writeNotifyCond.notify_all();
+    }
+    
+    std::mutex Logger::m_writeHookMutex;
+    Logger::WriteHook Logger::m_writeHook;
+    std::atomic<bool> Logger::m_hasWriteHook(false);
+    
+    void Logger::setWriteHook(const WriteHook& hook)
+    {
+        std::lock_guard<std::mutex> lk(m_writeHookMutex);
+        m_writeHook = hook;
+        m_hasWriteHook = static_cast<bool>(hook);
+    }
+    
+    size_t Logger::writeFile(const char* data, size_t size, const std::function<long(const char*, size_t)>& write)
+    {
+        WriteHook hook;
+        if(m_hasWriteHook.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lk(m_writeHookMutex);
+            hook = m_writeHook;
+        }
+        
+        size_t done = 0;
+        while(done < size)
+        {
+            WriteFault fault;
+            fault.delayUs = 0;
+            fault.size = size - done;
+            fault.error = 0;
+            if(hook)
+            {
+                hook(m_path, size - done, fault);
+                if(fault.delayUs > 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(fault.delayUs));
+                }
+            }
+            
+            const long written = fault.size > 0 ? write(data + done, std::min(fault.size, size - done)) : 0;
+            if(written > 0) {
+                done += static_cast<size_t>(written);
+            }
+            if(written <= 0 || fault.error != 0)
+            {
+                m_writeErrors++;
+                break;
+            }
+        }
+        return done;
+    }
+    
+    void Logger::setMaxOpenFiles(size_t maxOpenFiles)
+    {
+        std::lock_guard<std::mutex> cacheLk(m_fileCacheMutex);
+        m_maxOpenFiles = maxOpenFiles;
+        evictFiles(maxOpenFiles, nullptr);
+    }
+    
+    size_t Logger::getMaxOpenFiles()
+    {
+        return m_maxOpenFiles;
+    }
+    
+    Logger::FileCacheStats Logger::getFileCacheStats()
+    {
+        std::lock_guard<std::mutex> cacheLk(m_fileCacheMutex);
+        FileCacheStats stats = m_fileCacheStats;
+        stats.openFiles = m_openFiles.size();
+        for(FileCacheList::iterator it = m_openFiles.begin(); it != m_openFiles.end(); ++it) {
+            stats.hits += (*it)->m_fileCacheHits.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+    
+    void Logger::setReclaimIdleLoggers(bool reclaim)
+    {
+        std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
+        m_reclaimIdleLoggers = reclaim;
+    }
+    
+    size_t Logger::reclaimIdleLoggers()
+    {
+        //Declared before the lock, the loggers are destroyed after it is released
+        std::vector<LogPtr> reclaimed;
+        std::lock_guard<std::recursive_mutex> lk(m_managerMutex);
+        takeIdleLoggers(reclaimed);
+        return reclaimed.size();
+    }
+    
+    void Logger::takeIdleLoggers(std::vector<LogPtr>& reclaimed)
+    {
+        const size_t count = reclaimed.size();
+        for(LoggerContainer::iterator it = m_loggers.begin(); it != m_loggers.end(); )
+        {
+            //References are only handed out under m_managerMutex, a logger referenced only by the container cannot be in use
+            if(it->first != consoleLoggerFilePath && it->first != defaultLoggerFilePath && it->second.use_count() == 1)
+            {
+                reclaimed.push_back(std::move(it->second));
+                it = m_loggers.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        
+        std::lock_guard<std::mutex> cacheLk(m_fileCacheMutex);
+        m_fileCacheStats.reclaimed += reclaimed.size() - count;
+    }
+    
+    //Category related implementations
+    
+    std::mutex Logger::m_categoryMutex;
+    Logger::CategoryContainer Logger::m_categories;
+    Logger::CategoryLevelContainer Logger::m_categoryLevels;
+    Logger::CategoryWatcher Logger::m_categoryWatcher;
+    
+    Logger::CategoryWatcher::~CategoryWatcher()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            stop = true;
+        }
+        cond.notify_all();
+        if(thread.joinable()) thread.join();
+    }
+    
+    Logger::Category& Logger::getCategory(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lk(m_categoryMutex);
+        const CategoryContainer::iterator it = m_categories.find(name);
+        if(it != m_categories.end()) {
+            return *it->second;
+        }
+        
+        Category* pCategory = new Category(name);
+        m_categories[name] = std::unique_ptr<Category>(pCategory);
+        resolveCategoryLevels();
+        return *pCategory;
+    }
+    
+    void Logger::setCategoryLevel(const std::string& name, Level level)
+    {
+        std::lock_guard<std::mutex> lk(m_categoryMutex);
+        m_categoryLevels[name] = level;
+        resolveCategoryLevels();
+    }
+    
+    void Logger::resetCategoryLevel(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lk(m_categoryMutex);
+        m_categoryLevels.erase(name);
+        resolveCategoryLevels();
+    }
+    
+    void Logger::resolveCategoryLevels()
+    {
+        for(CategoryContainer::iterator it = m_categories.begin(); it != m_categories.end(); ++it)
+        {
+            int level = Category::LEVEL_INHERIT;
+            std::string name = it->first;
+            for(;;)
+            {
+                const CategoryLevelContainer::const_iterator found = m_categoryLevels.find(name);
+                if(found != m_categoryLevels.end()) {
+                    level = found->second;
+                    break;
+                }
+                
+                const size_t dot = name.find_last_of('.');
+                if(dot == std::string::npos) {
+                    const CategoryLevelContainer::const_iterator root = m_categoryLevels.find("*");
+                    if(root != m_categoryLevels.end()) level = root->second;
+                    break;
+                }
+                name.erase(dot);
+            }
+            it->second->m_level.store(level, std::memory_order_relaxed);
+        }
+    }
+    
+    static std::string trim(const std::string& str)
+    {
+        size_t begin = 0, end = str.size();
+        while(begin < end && std::isspace(static_cast<unsigned char>(str[begin]))) begin++;
+        while(end > begin && std::isspace(static_cast<unsigned char>(str[end - 1]))) end--;
+        return str.substr(begin, end - begin);
+    }
+    
+    static bool parseLogLevel(std::string str, int& level)
+    {
+        std::transform(str.begin(), str.end(), str.begin(), [](char c) { return static_cast<char>(std::toupper(static_cast<unsigned char>(c))); });
+        if(str == "ERROR" || str == "ERR") level = Logger::LOG_LEVEL_ERROR;
+        else if(str == "WARNING" || str == "WRN") level = Logger::LOG_LEVEL_WARNING;
+        else if(str == "NORMAL") level = Logger::LOG_LEVEL_NORMAL;
+        else if(str == "DEBUG" || str == "DBG") level = Logger::LOG_LEVEL_DEBUG;
+        else if(str == "INSANE") level = Logger::LOG_LEVEL_INSANE;
+        else
+        {
+            char* pEnd = nullptr;
+            const long value = std::strtol(str.c_str(), &pEnd, 10);
+            if(str.empty() || *pEnd != '\0' || value < Logger::LOG_LEVEL_ERROR || value > Logger::LOG_LEVEL_INSANE) return false;
+            level = static_cast<int>(value);
+        }
+        return true;
+    }
+    
+    static bool readFile(const std::string& path, std::string& content)
+    {
+        std::ifstream inFile(path.c_str(), std::ios::in | std::ios::binary);
+        if(!inFile.is_open()) return false;
+        std::ostringstream ss;
+        ss << inFile.rdbuf();
+        content = ss.str();
+        return true;
+    }
+    
+    static bool parseCategoryLevels(const std::string& content, std::map<std::string, int>& levels)
+    {
+        std::istringstream ss(content);
+        std::string line;
+        while(std::getline(ss, line))
+        {
+            line = trim(line);
+            if(line.empty() || line[0] == '#') continue;
+            
+            const size_t eq = line.find('=');
+            if(eq == std::string::npos) return false;
+            
+            const std::string name = trim(line.substr(0, eq));
+            int level = 0;
+            if(name.empty() || !parseLogLevel(trim(line.substr(eq + 1)), level)) return false;
+            levels[name] = level;
+        }
+        return true;
+    }
+    
+    Logger::Result Logger::loadCategoryLevels(const std::string& configPath)
+    {
+        std::string content;
+        if(!readFile(configPath, content)) {
+            return RES_FILE_ERROR;
+        }
+        
+        CategoryLevelContainer levels;
+        if(!parseCategoryLevels(content, levels)) {
+            return RES_BAD_ARGS;
+        }
+        
+        std::lock_guard<std::mutex> lk(m_categoryMutex);
+        m_categoryLevels.swap(levels);
+        resolveCategoryLevels();
+        return RES_OK;
+    }
+    
+    void Logger::categoryWatcherThread(std::string configPath, unsigned pollIntervalMs)
+    {
+        std::string lastContent;
+        bool loaded = false;
+        
+        std::unique_lock<std::mutex> lk(m_categoryWatcher.mutex);
+        while(!m_categoryWatcher.stop)
+        {
+            lk.unlock();
+            std::string content;
+            if(readFile(configPath, content) && (!loaded || content != lastContent))
+            {
+                CategoryLevelContainer levels;
+                //A half written file fails to parse, it is retried on the next poll
+                if(parseCategoryLevels(content, levels))
+                {
+                    std::lock_guard<std::mutex> categoryLock(m_categoryMutex);
+                    m_categoryLevels.swap(levels);
+                    resolveCategoryLevels();
+                    lastContent = content;
+                    loaded = true;
+                }
+            }
+            lk.lock();
+            m_categoryWatcher.cond.wait_for(lk, std::chrono::milliseconds(pollIntervalMs), [] { return m_categoryWatcher.stop; });
+        }
+    }
+    
+    Logger::Result Logger::watchCategoryLevels(const std::string& configPath, unsigned pollIntervalMs)
+    {
+        if(pollIntervalMs == 0) {
+            return RES_BAD_ARGS;
+        }
+        
+        //Concurrent calls are serialized, otherwise two of them could start a thread in the same slot
+        std::lock_guard<std::mutex> controlLk(m_categoryWatcher.controlMutex);
+        stopCategoryWatcher();
+        
+        std::lock_guard<std::mutex> lk(m_categoryWatcher.mutex);
+        m_categoryWatcher.stop = false;
+        m_categoryWatcher.thread = std::thread(categoryWatcherThread, configPath, pollIntervalMs);
+        return RES_OK;
+    }
+    
+    void Logger::stopWatchingCategoryLevels()
+    {
+        std::lock_guard<std::mutex> controlLk(m_categoryWatcher.controlMutex);
+        stopCategoryWatcher();
+    }
+    
+    void Logger::stopCategoryWatcher()
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_categoryWatcher.mutex);
+            m_categoryWatcher.stop = true;
+        }
+        m_categoryWatcher.cond.notify_all();
+        if(m_categoryWatcher.thread.joinable()) m_categoryWatcher.thread.join();
+    }
+    
+    //Call site related implementations
+    
+    std::atomic<Logger::CallSite*> Logger::m_callSites(nullptr);
+    std::mutex Logger::m_callSiteMutex;
+    std::vector<Logger::CallSiteRule> Logger::m_callSiteRules;
+    
+    Logger::CallSite::CallSite(const char* sourceFile, int sourceLine, const char* levelText, const char* loggerText) :
+    file(sourceFile), line(sourceLine), level(levelText), logger(loggerText), enabled(true), hits(0), bytes(0), nanoseconds(0), m_pNext(nullptr)
+    {
+        //The site is listed under the same lock as the rules, a rule set meanwhile either is applied here or finds the site in the list
+        std::lock_guard<std::mutex> lk(m_callSiteMutex);
+        for(size_t i=0; i < m_callSiteRules.size(); i++) {
+            if(matchCallSite(*this, m_callSiteRules[i].file, m_callSiteRules[i].line)) enabled = m_callSiteRules[i].enabled;
+        }
+        
+        //Sites are never removed, pushing to the head is the only update of the list. Readers walk it without the lock.
+        m_pNext = m_callSites.load(std::memory_order_relaxed);
+        m_callSites.store(this, std::memory_order_release);
+    }
+    
+    void Logger::CallSite::count(size_t messageSize, const std::chrono::steady_clock::time_point& start)
+    {
+        const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+        hits.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(messageSize, std::memory_order_relaxed);
+        nanoseconds.fetch_add(static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()), std::memory_order_relaxed);
+    }
+    
+    bool Logger::matchCallSite(const CallSite& site, const std::string& file, int line)
+    {
+        if(line != 0 && site.line != line) {
+            return false;
+        }
+        //File has to be a suffix of the path starting a path component
+        const size_t length = strlen(site.file);
+        if(file.empty() || file.size() > length || file.compare(0, file.size(), site.file + length - file.size()) != 0) {
+            return false;
+        }
+        const size_t start = length - file.size();
+        return start == 0 || site.file[start - 1] == '/' || site.file[start - 1] == '\\';
+    }
+    
+    std::vector<Logger::CallSiteStats> Logger::getTopCallSites(size_t count)
+    {
+        std::vector<CallSiteStats> sites;
+        for(CallSite* pSite = m_callSites.load(std::memory_order_acquire); pSite; pSite = pSite->m_pNext)
+        {
+            CallSiteStats stats;
+            stats.file = pSite->file;
+            stats.line = pSite->line;
+            stats.level = pSite->level;
+            stats.logger = pSite->logger;
+            stats.enabled = pSite->enabled.load(std::memory_order_relaxed);
+            stats.hits = pSite->hits.load(std::memory_order_relaxed);
+            stats.bytes = pSite->bytes.load(std::memory_order_relaxed);
+            stats.nanoseconds = pSite->nanoseconds.load(std::memory_order_relaxed);
+            sites.push_back(stats);
+        }
+        
+        std::sort(sites.begin(), sites.end(), [](const CallSiteStats& a, const CallSiteStats& b) {
+            return a.bytes != b.bytes ? a.bytes > b.bytes : a.hits > b.hits;
+        });
+        if(count > 0 && sites.size() > count) {
+            sites.resize(count);
+        }
+        return sites;
+    }
+    
+    void Logger::dumpTopCallSites(std::ostream& os, size_t count)
+    {
+        const std::vector<CallSiteStats> sites = getTopCallSites(count);
+        os << std::setw(14) << "bytes" << std::setw(12) << "hits" << std::setw(12) << "ns/record" << "  on   level / logger / location" << std::endl;
+        for(size_t i=0; i < sites.size(); i++)
+        {
+            const CallSiteStats& site = sites[i];
+            os << std::setw(14) << site.bytes << std::setw(12) << site.hits << std::setw(12) << (site.hits ? site.nanoseconds / site.hits : 0)
+               << (site.enabled ? "  on   " : "  off  ") << site.level << " / " << site.logger << " / " << site.file << ":" << site.line << std::endl;
+        }
+    }
+    
+    size_t Logger::setCallSiteEnabled(const std::string& file, int line, bool enabled)
+    {
+        std::lock_guard<std::mutex> lk(m_callSiteMutex);
+        
+        //Rules are applied in order, an updated rule moves to the end so the last call wins
+        for(size_t i=0; i < m_callSiteRules.size(); i++)
+        {
+            if(m_callSiteRules[i].file == file && m_callSiteRules[i].line == line)
+            {
+                m_callSiteRules.erase(m_callSiteRules.begin() + i);
+                break;
+            }
+        }
+        CallSiteRule rule;
+        rule.file = file;
+        rule.line = line;
+        rule.enabled = enabled;
+        m_callSiteRules.push_back(rule);
+        
+        size_t count = 0;
+        for(CallSite* pSite = m_callSites.load(std::memory_order_acquire); pSite; pSite = pSite->m_pNext)
+        {
+            if(matchCallSite(*pSite, file, line))
+            {
+                pSite->enabled.store(enabled, std::memory_order_relaxed);
+                count++;
+            }
+        }
+        return count;
+    }
+    
+    void Logger::resetCallSiteCounters()
+    {
+        for(CallSite* pSite = m_callSites.load(std::memory_order_acquire); pSite; pSite = pSite->m_pNext)
+        {
+            pSite->hits.store(0, std::memory_order_relaxed);
+            pSite->bytes.store(0, std::memory_order_relaxed);
+            pSite->nanoseconds.store(0, std::memory_order_relaxed);
+        }
+    }
 }
 
 
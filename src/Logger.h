@@ -16,13 +16,32 @@
 #include <iostream>
 #include <memory>
 #include <unordered_map>
+#include <map>
+#include <list>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <functional>
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#define RW_HAS_COROUTINES 1
+#endif
 
 namespace rw
 {
+// Static descriptor of a log statement, registered when the statement runs for the first time
+#define RW_CALL_SITE(level, logger) ([]() -> Logger::CallSite& { static Logger::CallSite site(__FILE__, __LINE__, #level, (logger)); return site; }())
 // Logger convenience macros.
-#define LOGC(level) Logger::getConsoleLogger()->operator()((level))
-#define LOGD(level) Logger::getDefaultLogger()->operator()((level))
-#define LOGF(level, file) Logger::getFileLogger((file))->operator()((level))
+#define LOGC(level) Logger::getConsoleLogger()->operator()((level), RW_CALL_SITE(level, "console"))
+#define LOGD(level) Logger::getDefaultLogger()->operator()((level), RW_CALL_SITE(level, "default"))
+#define LOGF(level, file) Logger::getFileLogger((file))->operator()((level), RW_CALL_SITE(level, #file))
+// Category variants, category is a Logger::Category& retrieved once via Logger::getCategory
+#define LOGC_CAT(level, category) Logger::getConsoleLogger()->operator()((level), (category), RW_CALL_SITE(level, "console"))
+#define LOGD_CAT(level, category) Logger::getDefaultLogger()->operator()((level), (category), RW_CALL_SITE(level, "default"))
+#define LOGF_CAT(level, file, category) Logger::getFileLogger((file))->operator()((level), (category), RW_CALL_SITE(level, #file))
     
     /**
      * @brief    Thread safe Logger class.
@@ -54,44 +73,279 @@ namespace rw
             RES_FILE_ERROR,             ///< A file error occured (most probrably file not found or supported)
         };
         
+        enum FloatFormat {
+            FLOAT_FORMAT_STREAM = 0,    ///< Floating point values are formatted by the stream, honoring precision and flags (default, %g like output)
+            FLOAT_FORMAT_SHORTEST = 1   ///< Floating point values are formatted with the shortest digits which round trip, like std::to_chars without a format
+        };
+        
+        /**
+         * @brief    Named category of log statements, e.g. "net.http" or "db". Categories are shared by all loggers and live until the process exits.
+         *           The level of a category is taken from the most specific configured name among "net.http", "net" and "*".
+         *           It is resolved into m_level whenever the configuration changes so that checking a statement is a single relaxed load.
+         *           When nothing is configured the level of the logger is used.
+         */
+        class Category
+        {
+        public:
+            const std::string& getName() const { return m_name; }
+            
+        private:
+            friend class Logger;
+            
+            explicit Category(const std::string& name) : m_name(name), m_level(LEVEL_INHERIT)
+            {
+            }
+            Category(const Category& other);
+            
+            static const int        LEVEL_INHERIT = 0x7fff;    ///< Sentinel for m_level, use the level of the logger
+            
+            std::string             m_name;
+            std::atomic<int>        m_level;                   ///< Effective level of the category or LEVEL_INHERIT
+        };
+        
+        /**
+         * @brief    Descriptor of a log statement of the LOG macros, one static instance per statement.
+         *           Descriptors are pushed to a global lock-free list when their statement runs for the first time and live until the process exits.
+         *           A disabled statement is dropped before anything is formatted. Counters are relaxed atomics updated by logged records only.
+         */
+        class CallSite
+        {
+        public:
+            CallSite(const char* sourceFile, int sourceLine, const char* levelText, const char* loggerText);
+            
+            const char* const       file;                       ///< __FILE__ of the statement
+            const int               line;                       ///< __LINE__ of the statement
+            const char* const       level;                      ///< Level expression as written in the statement
+            const char* const       logger;                     ///< "console", "default" or the file expression of the statement
+            
+            std::atomic<bool>       enabled;
+            std::atomic<unsigned long long> hits;               ///< Records logged
+            std::atomic<unsigned long long> bytes;              ///< Message bytes logged
+            std::atomic<unsigned long long> nanoseconds;        ///< Time spent formatting and writing the records
+            
+        private:
+            friend class Logger;
+            CallSite(const CallSite& other);
+            
+            /**
+             * @brief                   Adds a logged record to the counters.
+             */
+            void count(size_t messageSize, const std::chrono::steady_clock::time_point& start);
+            
+            CallSite*               m_pNext;                    ///< Next descriptor in the registry
+        };
+        
+        /**
+         * @brief    Snapshot of a call site returned by getTopCallSites.
+         */
+        struct CallSiteStats
+        {
+            std::string             file;
+            int                     line;
+            std::string             level;
+            std::string             logger;
+            bool                    enabled;
+            unsigned long long      hits;
+            unsigned long long      bytes;
+            unsigned long long      nanoseconds;
+        };
+        
+        /**
+         * @brief    Budgets of the load governor of a logger (see setGovernor). A budget of 0 is not checked.
+         */
+        struct GovernorConfig
+        {
+            unsigned                maxLatencyUs;       ///< 99th percentile of the time a statement spends writing its record, in microseconds
+            unsigned long long      maxBytesPerSecond;  ///< Bytes of records written per second
+            size_t                  maxBacklog;         ///< Records waiting for the I/O thread of asynchronous logging
+            unsigned                windowMs;           ///< Length of a measurement window in milliseconds, the budgets are checked at the end of each
+            unsigned                sampleInterval;     ///< One of this many records of a thread is timed and counted for the byte rate, shed statements are counted the same way
+            unsigned                restoreWindows;     ///< Consecutive windows under half of the budgets before a level is restored
+            
+            GovernorConfig() : maxLatencyUs(0), maxBytesPerSecond(0), maxBacklog(0), windowMs(1000), sampleInterval(16), restoreWindows(3) {}
+        };
+        
+        /**
+         * @brief    Counters of the load governor returned by getGovernorStats.
+         */
+        struct GovernorStats
+        {
+            Level                   level;              ///< Most verbose level let through by the governor, LOG_LEVEL_INSANE if nothing is shed
+            unsigned long long      sheds;              ///< Transitions which dropped a level
+            unsigned long long      restores;           ///< Transitions which restored a level
+            unsigned long long      shedRecords;        ///< Statements dropped by the governor, counted in steps of the sample interval per thread
+        };
+    
     private:
         
         //Child ostringstream class enabling << operator to be used by users
         //It enables user defined types to be logged
         //Created for each user log call and flushes its message using Logger just before its destruction
         //http://www.vilipetek.com/2014/04/17/thread-safe-simple-logger-in-c11/
+        //Built-in arithmetic types bypass num_put and are formatted by the kernels in Logger.cpp as long as
+        //the stream has default flags. Every insertion returns logstream& so that chained values keep the fast path.
         class logstream : public std::ostringstream
         {
         public:
-            logstream(Logger& oLogger, const Level& level) :
-            m_logger(oLogger), m_logLevel(level)
+            logstream(Logger& oLogger, const Level& level, const Category* pCategory = nullptr, CallSite* pSite = nullptr) :
+            m_logger(oLogger), m_logLevel(level), m_active(false), m_classicLocale(-1), m_pSite(pSite)
             {
+                if((!pSite || pSite->enabled.load(std::memory_order_relaxed)) && oLogger.isLevelLogged(level, pCategory))
+                {
+                    //Statements over the level let through by the load governor are counted by it
+                    m_active = level <= oLogger.m_shedLevel.load(std::memory_order_relaxed);
+                    if(!m_active) oLogger.shedRecord();
+                }
+                
+                //Filtered statements do not format anything, insertions fail at the stream sentry
+                if(!m_active) setstate(std::ios_base::badbit);
+                else if(m_pSite) m_start = std::chrono::steady_clock::now();
             }
             
             logstream(const logstream& ls) :
-            m_logger(ls.m_logger), m_logLevel(ls.m_logLevel)
+            m_logger(ls.m_logger), m_logLevel(ls.m_logLevel), m_active(ls.m_active), m_classicLocale(-1), m_pSite(ls.m_pSite), m_start(ls.m_start)
             {
+                if(!m_active) setstate(std::ios_base::badbit);
             }
             
             virtual ~logstream()
             {
-                m_logger.doLog(m_logLevel, str());
+                if(!m_active) {
+                    return;
+                }
+                if(m_pSite)
+                {
+                    const std::string message = str();
+                    m_logger.doLog(m_logLevel, message);
+                    m_pSite->count(message.size(), m_start);
+                }
+                else
+                {
+                    m_logger.doLog(m_logLevel, str());
+                }
             }
             
+            template<typename T>
+            friend logstream& operator<<(logstream& ls, const T& value)
+            {
+                static_cast<std::ostream&>(ls) << value;
+                return ls;
+            }
+            
+            //Needed for the first insertion on the temporary, more specialized than the generic rvalue stream insertion of the standard library
+            template<typename T>
+            friend logstream& operator<<(logstream&& ls, const T& value)
+            {
+                static_cast<std::ostream&>(ls) << value;
+                return ls;
+            }
+            
+            logstream& operator<<(std::ostream& (*manip)(std::ostream&))
+            {
+                manip(*this);
+                return *this;
+            }
+            
+            logstream& operator<<(std::ios_base& (*manip)(std::ios_base&))
+            {
+                manip(*this);
+                return *this;
+            }
+            
+            logstream& operator<<(short value)              { return putSigned(value); }
+            logstream& operator<<(int value)                { return putSigned(value); }
+            logstream& operator<<(long value)               { return putSigned(value); }
+            logstream& operator<<(long long value)          { return putSigned(value); }
+            logstream& operator<<(unsigned short value)     { return putUnsigned(value); }
+            logstream& operator<<(unsigned int value)       { return putUnsigned(value); }
+            logstream& operator<<(unsigned long value)      { return putUnsigned(value); }
+            logstream& operator<<(unsigned long long value) { return putUnsigned(value); }
+            logstream& operator<<(float value);
+            logstream& operator<<(double value);
+            
+            //Hides basic_ios::imbue to invalidate the cached locale check
+            std::locale imbue(const std::locale& loc)
+            {
+                m_classicLocale = -1;
+                return std::ostringstream::imbue(loc);
+            }
+        
         private:
+            /**
+             * @brief                   Checks whether the stream state allows bypassing num_put without changing the output.
+             *                          Requires decimal base, default float field, no showpos/showpoint/uppercase, zero width and the classic locale.
+             *                          The locale comparison is done once per stream since copying the locale is not cheap.
+             */
+            bool isPlainFormat();
+            
+            void writeSigned(long long value);
+            void writeUnsigned(unsigned long long value);
+            
+            template<typename T>
+            logstream& putSigned(T value)
+            {
+                if(m_active && isPlainFormat()) writeSigned(value);
+                else static_cast<std::ostream&>(*this) << value;
+                return *this;
+            }
+            
+            template<typename T>
+            logstream& putUnsigned(T value)
+            {
+                if(m_active && isPlainFormat()) writeUnsigned(value);
+                else static_cast<std::ostream&>(*this) << value;
+                return *this;
+            }
+            
             Logger& m_logger;
             Level m_logLevel;
+            bool m_active;          ///< False if the statement is filtered out by level, category or enable state
+            int m_classicLocale;    ///< -1 until checked, then 1 if the stream uses the classic locale
+            CallSite* m_pSite;      ///< Descriptor of the statement, null if it is not written with the LOG macros
+            std::chrono::steady_clock::time_point m_start;
         };
         
         std::string             m_path;                         ///< Output file path. In case of empty string, Logger do not write to a file
         void                    *m_pFile;                       ///< Output file. It's opened only when required.
         bool                    m_reflectToConsole;             ///< If true, logger also logs to std::cout or std::cerr (error level messages).
-        bool                    m_enabled;                      ///< Enables/disables logging
+        std::atomic<bool>       m_enabled;                      ///< Enables/disables logging
         size_t                  m_maxLogSize;                   ///< Approximate max length of log file in bytes.
         std::recursive_mutex    m_logMutex;                     ///< For locking logging operation in a multi threaded environment
-        Level                   m_logLevel;                     ///< Defines the level of importance of the messages, only this and lower level messages are logged.
+        std::atomic<Level>      m_logLevel;                     ///< Defines the level of importance of the messages, only this and lower level messages are logged.
         OverflowAction          m_overflowAction;               ///< Decides what to do when the log size exceeds max log sizes
-        const size_t            m_minLogSize = 512;             ///< Minimum value of maximum log size and minimum size after truncation/rotation
+        std::atomic<FloatFormat> m_floatFormat;                 ///< Decides how logstream formats float and double values
+        
+        struct SharedFile;
+        SharedFile              *m_pShared;                     ///< Multi-process state of loggers created by getSharedFileLogger, null otherwise.
+        
+        struct RingTransport;
+        RingTransport           *m_pRing;                       ///< Shared memory ring of loggers created by getRingLogger, null otherwise.
+        
+        std::list<Logger*>::iterator m_fileCacheIt;             ///< Position in m_openFiles, valid if m_fileCached. Both are protected by m_fileCacheMutex.
+        bool                    m_fileCached;                   ///< True while m_pFile is open and counted against the open file limit
+        std::atomic<unsigned long long> m_fileUseStamp;         ///< m_fileCacheClock when the file was last used, evictFiles closes the lowest first
+        std::atomic<unsigned long long> m_fileCacheHits;        ///< Hits not yet added to m_fileCacheStats, added when the file is closed
+        unsigned long long      m_fileDevice;                   ///< Device of the path when m_pFile was opened
+        unsigned long long      m_fileInode;                    ///< Inode of the path when m_pFile was opened, a different one means the file was replaced
+        std::chrono::steady_clock::time_point m_fileCheckTime;  ///< Last time the path was compared with the open file
+        
+        struct AsyncRequest;
+        struct AsyncWriter;
+        AsyncWriter             *m_pAsync;                      ///< I/O thread and queue of asynchronous records, created by the first asynchronous call.
+        std::mutex              m_asyncMutex;                   ///< Protects m_pAsync, its queue and the counters below. Never held during I/O.
+        std::atomic<bool>       m_asyncLogging;                 ///< If true, statements are queued for the I/O thread instead of being written by the caller
+        size_t                  m_asyncCapacity;                ///< Maximum number of queued fire-and-forget records
+        unsigned long long      m_asyncDropped;                 ///< Fire-and-forget records dropped because the queue was full
+        
+        struct RotationWorker;
+        RotationWorker          *m_pRotation;                   ///< Background thread preparing the next file of a rotating logger, null unless async rotation is enabled. Protected by m_logMutex.
+        
+        struct Governor;
+        std::atomic<Governor*>  m_pGovernor;                    ///< Load governor, null until setGovernor is called. Kept until the logger is destructed.
+        std::atomic<int>        m_shedLevel;                    ///< Most verbose level let through by the governor
+        
+        std::atomic<unsigned long long> m_writeErrors;          ///< Failed writes of the log file
+        bool                    m_tornRecord;                   ///< True if a failed write left a partial line in the file. Protected by m_logMutex.
         
     public:
         
@@ -118,7 +372,7 @@ namespace rw
         size_t getMaxLogSize() const;
         
         /**
-         * @brief                       Sets the log level.
+         * @brief                       Sets the log level. Does not lock, writers see the new level with their next statement.
          * @param    level              The log level. Only this and lower level messages are logged.
          */
         void setLogLevel( Level level );
@@ -129,6 +383,29 @@ namespace rw
          */
         Level getLogLevel() const;
         
+        /**
+         * @brief                       Sets the formatting of float and double values logged with << operator.
+         * @param    format             FLOAT_FORMAT_STREAM keeps the stream output (precision 6 by default), FLOAT_FORMAT_SHORTEST writes round trip digits.
+         */
+        void setFloatFormat( FloatFormat format );
+        
+        /**
+         * @brief                       Gets the float format.
+         * @return                      The float format.
+         */
+        FloatFormat getFloatFormat() const;
+        
+        /**
+         * @brief                       Moves the file operations of a rotation off the writers. A background thread creates the next file in advance (path + ".next"),
+                                        so the writer crossing the maximum size only renames the two files and switches to the open next file.
+                                        The rotated file is closed, and synced if requested, by the background thread. If the next file is not ready yet,
+                                        the writer rotates as usual. Only loggers created with ACTION_ROTATE are affected. Not supported on Windows,
+                                        where open files cannot be renamed, rotation stays synchronous there.
+         * @param    async              true to start the background thread, false to stop it (default).
+         * @param    syncRotated        true to fsync each rotated file before it is closed.
+         */
+        void setAsyncRotation( bool async, bool syncRotated = false );
+        
         /**
          * @brief                       Gets the path to log file. Logger does not keep track any information about truncated or rotated logs.
                                         Therefore, this path is the initialized path that the object is logging
@@ -136,6 +413,12 @@ namespace rw
          */
         std::string getPath() const;
         
+        /**
+         * @brief                       Gets the number of failed writes of the log file. The record of a failed write is lost, a part of it may be in the file.
+         * @return                      The failed write count.
+         */
+        unsigned long long getWriteErrorCount() const;
+        
         /**
          * @brief                       Gets the current size of the log file. Logger does not keep track any information about truncated or rotated logs.
                                         Therefore, this size is the size remaining of the file after any number truncations or rotations
@@ -153,6 +436,168 @@ namespace rw
         {
             return logstream(*this, level);
         }
+        
+        /**
+         * @brief                       Overloaded () operator for logging within a category
+                                        The level of the category overrides the level of the logger if it is configured
+         * @param    level              The log level.
+         * @param    category           The category of the statement.
+         * @return                      custom ostringstream object
+         */
+        logstream operator()(const Level& level, const Category& category)
+        {
+            return logstream(*this, level, &category);
+        }
+        
+        /**
+         * @brief                       Overloaded () operator used by the LOG macros, the statement is counted in its call site and dropped if the site is disabled.
+         * @param    level              The log level.
+         * @param    site               The call site of the statement.
+         * @return                      custom ostringstream object
+         */
+        logstream operator()(const Level& level, CallSite& site)
+        {
+            return logstream(*this, level, nullptr, &site);
+        }
+        
+        logstream operator()(const Level& level, const Category& category, CallSite& site)
+        {
+            return logstream(*this, level, &category, &site);
+        }
+        
+        /**
+         * @brief                       Checks if a statement with the given level and category would be logged. Does not lock.
+         * @param    level              The log level.
+         * @param    pCategory          The category of the statement, null for uncategorized statements.
+         * @return                      true if the statement is logged.
+         */
+        bool isLogged(const Level& level, const Category* pCategory = nullptr) const
+        {
+            return isLevelLogged(level, pCategory) && level <= m_shedLevel.load(std::memory_order_relaxed);
+        }
+        
+        //Load governor
+        
+        /**
+         * @brief                       Starts or reconfigures the load governor of the logger. The governor times sampled statements and counts the written bytes
+                                        in windows. At the end of a window which exceeds a budget it sheds DEBUG (and INSANE) statements, at the end of the next one
+                                        also NORMAL statements. WARNING and ERROR statements are never shed. Levels are restored one by one once the budgets
+                                        are met with the shed statements counted in for restoreWindows consecutive windows. Every transition is logged as a warning.
+         * @param    config             The budgets.
+         * @return                      RES_OK if successful, RES_BAD_ARGS if no budget is set or the window is 0.
+         */
+        Result setGovernor(const GovernorConfig& config);
+        
+        /**
+         * @brief                       Stops the load governor and restores the shed levels. Counters are kept.
+         */
+        void removeGovernor();
+        
+        /**
+         * @brief                       Gets the state and the counters of the load governor.
+         * @return                      The governor state, without shedding and with zero counters if setGovernor was never called.
+         */
+        GovernorStats getGovernorStats();
+        
+        //Asynchronous logging
+        
+        /**
+         * @brief    Receives the result of an asynchronous write or flush.
+         */
+        typedef std::function<void(Result)> Completion;
+        
+        /**
+         * @brief    Runs a completion on a thread chosen by the caller, e.g. by posting it to the caller's event loop or coroutine scheduler.
+         *           An empty executor runs completions on the I/O thread of the logger, they should not block then.
+         */
+        typedef std::function<void(std::function<void()>)> Executor;
+        
+        /**
+         * @brief                       Makes the statements of the logger fire-and-forget: the caller formats the record and queues it,
+                                        the I/O thread of the logger writes it. Records are dropped when the queue is full (see setAsyncQueueCapacity).
+         * @param    async              true to queue the statements, false to write them by the calling thread (default).
+         */
+        void setAsyncLogging( bool async );
+        bool isAsyncLogging( ) const;
+        
+        /**
+         * @brief                       Queues a record for the I/O thread without blocking on I/O. Filtered records are not queued.
+         * @param    level              The log level.
+         * @param    message            The message.
+         * @return                      false if the record is filtered out or dropped because the queue is full.
+         */
+        bool post(const Level& level, const std::string& message);
+        
+        /**
+         * @brief                       Queues a record and completes once it and all records queued before it are written and synced to the disk.
+                                        Never dropped, the queue limit does not apply. Records of ring loggers are complete once they are in the ring.
+         * @param    level              The log level. A filtered record is not written but still completes after the sync.
+         * @param    message            The message.
+         * @param    completion         Called with RES_OK, or RES_FILE_ERROR if the file cannot be synced.
+         * @param    executor           Runs the completion, empty to run it on the I/O thread.
+         */
+        void writeAsync(const Level& level, const std::string& message, const Completion& completion, const Executor& executor = Executor());
+        
+        /**
+         * @brief                       Completes once all records queued before the call are written and synced to the disk.
+         * @param    completion         Called with RES_OK, or RES_FILE_ERROR if the file cannot be synced.
+         * @param    executor           Runs the completion, empty to run it on the I/O thread.
+         */
+        void flushAsync(const Completion& completion, const Executor& executor = Executor());
+        
+        /**
+         * @brief                       Sets the number of fire-and-forget records which can wait for the I/O thread. Default is 8192.
+         * @param    capacity           The queue capacity.
+         */
+        void setAsyncQueueCapacity( size_t capacity );
+        
+        /**
+         * @brief                       Gets the number of fire-and-forget records dropped because the queue was full.
+         * @return                      The drop count.
+         */
+        unsigned long long getAsyncDroppedCount();
+        
+#ifdef RW_HAS_COROUTINES
+        /**
+         * @brief    Awaitable of write and flush, e.g. "Result res = co_await logger->flush(executor);".
+         *           The coroutine is resumed by the executor, or by the I/O thread if the executor is empty.
+         */
+        class AsyncOperation
+        {
+        public:
+            AsyncOperation(Logger& oLogger, bool record, const Level& level, const std::string& message, const Executor& executor) :
+            m_logger(oLogger), m_record(record), m_level(level), m_message(message), m_executor(executor), m_result(RES_ERROR) {}
+            
+            bool await_ready() const noexcept { return false; }
+            
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                Completion completion = [this, handle](Result res) { m_result = res; handle.resume(); };
+                if(m_record) m_logger.writeAsync(m_level, m_message, completion, m_executor);
+                else m_logger.flushAsync(completion, m_executor);
+            }
+            
+            Result await_resume() const noexcept { return m_result; }
+            
+        private:
+            Logger& m_logger;
+            bool m_record;
+            Level m_level;
+            std::string m_message;
+            Executor m_executor;
+            Result m_result;
+        };
+        
+        AsyncOperation write(const Level& level, const std::string& message, const Executor& executor = Executor())
+        {
+            return AsyncOperation(*this, true, level, message, executor);
+        }
+        
+        AsyncOperation flush(const Executor& executor = Executor())
+        {
+            return AsyncOperation(*this, false, LOG_LEVEL_NORMAL, std::string(), executor);
+        }
+#endif
     
     private:
         //Cannot instantiate object outside Logger class
@@ -161,16 +606,85 @@ namespace rw
         Logger(const Logger& other);
         
         /**
-         * @brief                       Opens m_pFile (does not create, only opens).
+         * @brief                       Checks the level and category filters and the enable state, without the load governor.
+         */
+        bool isLevelLogged(const Level& level, const Category* pCategory) const
+        {
+            if(!m_enabled.load(std::memory_order_relaxed)) return false;
+            int threshold = pCategory ? pCategory->m_level.load(std::memory_order_relaxed) : Category::LEVEL_INHERIT;
+            if(threshold == Category::LEVEL_INHERIT) threshold = m_logLevel.load(std::memory_order_relaxed);
+            return level <= threshold;
+        }
+        
+        /**
+         * @brief                       Counts a statement dropped by the load governor. Checks the budgets from time to time, so that shed levels are restored
+                                        even if only shed statements are logged.
+         */
+        void shedRecord();
+        
+        /**
+         * @brief                       Closes the measurement window of the load governor if it is over, and sheds or restores a level if needed.
+         *                              The transition is logged after the governor is unlocked.
+         * @param   pGovernor           The governor.
+         * @param   now                 Current time.
+         */
+        void checkGovernor(Governor* pGovernor, const std::chrono::steady_clock::time_point& now);
+        
+        /**
+         * @brief                       Opens m_pFile (does not create, only opens). An open file is reopened if its path was replaced.
          * @return                      RESULT_OK if successful.
          */
         Result open();
         
         /**
-         * @brief                       Closes m_pFile (does not delete, only closes).
+         * @brief                       Closes m_pFile (does not delete, only closes) and removes it from the open file cache.
          */
         void close();
         
+        /**
+         * @brief                       Adds the newly opened m_pFile to the open file cache and closes the least recently used files of other loggers
+                                        while there are more than m_maxOpenFiles. m_logMutex must be held.
+         */
+        void cacheFile();
+        
+        /**
+         * @brief                       Records the identity of the file at m_path after m_pFile is opened. m_logMutex must be held.
+         */
+        void rememberFileIdentity();
+        
+        /**
+         * @brief                       Checks at most every RW_FILE_CHECK_INTERVAL_MS whether m_path was renamed, removed or replaced by another
+                                        process (e.g. logrotate) while m_pFile is open. m_logMutex must be held.
+         * @return                      true if m_pFile no longer is the file at m_path and has to be reopened.
+         */
+        bool isFileReplaced();
+        
+        /**
+         * @brief                       Closes the files of least recently used loggers until at most maxOpenFiles are open. m_fileCacheMutex must be held.
+                                        Recency is the use stamp, so loggers used since the same file was opened are equally recent.
+                                        Loggers which are busy are skipped, their locks are never waited for, so the limit can be exceeded for a while.
+         * @param    maxOpenFiles       Number of files allowed to stay open.
+         * @param    pExcept            Logger whose file is kept, null if none.
+         */
+        static void evictFiles(size_t maxOpenFiles, const Logger* pExcept);
+        
+        /**
+         * @brief                       Moves the loggers referenced only by the container to reclaimed. m_managerMutex must be held.
+                                        Callers release them after unlocking, a logger joins its I/O thread when it is destroyed and
+                                        completions running there may call the manager.
+         * @param    reclaimed          Receives the removed loggers.
+         */
+        static void takeIdleLoggers(std::vector<std::shared_ptr<Logger>>& reclaimed);
+        
+        /**
+         * @brief                       Writes to the log file through the write hook, continuing short writes. Failed writes are counted.
+         * @param   data                Start of the buffer.
+         * @param   size                Size of the buffer.
+         * @param   write               Writes a part of the buffer to the file, returns the number of bytes written or -1 if the write fails.
+         * @return                      Number of bytes written, less than size if a write failed.
+         */
+        size_t writeFile(const char* data, size_t size, const std::function<long(const char*, size_t)>& write);
+        
         /**
          * @brief                       Truncates the  log file if the log size exceeds maximum size to the given new length. Length is approximate.
          * @param   newLen              New length of the log file. If new length is smaller then min length is assigned as new length
@@ -187,15 +701,152 @@ namespace rw
         Result rotate();
         
         /**
-         * @brief    Does the actual logging with given level and message.
+         * @brief                       Rotates by switching to the file prepared by the rotation thread. m_logMutex must be held.
+         * @param   rotatedPath         New path of the current file.
+         * @return                      false if the next file is not ready, the caller rotates synchronously then.
+         */
+        bool rotateToNextFile(const std::string& rotatedPath);
+        
+        /**
+         * @brief                       Stops the rotation thread after it closed the rotated files, and removes the prepared file.
+         */
+        void stopRotation();
+        
+        /**
+         * @brief                       Body of the rotation thread. Closes the rotated files and keeps the next file ready.
+         */
+        static void rotationThread(RotationWorker* pWorker);
+        
+        /**
+         * @brief    Does the actual logging with given level and message. Times the call for the load governor if it is sampled.
          */
         void doLog(const Level& level, const std::string& message);
         
+        /**
+         * @brief    Sends a record to the ring, the I/O thread or writeRecord.
+         */
+        void emitRecord(const Level& level, const std::string& message);
+        
+        /**
+         * @brief    Writes a formatted record to the file and/or console, truncating or rotating the file if needed.
+         * @param   level               The log level.
+         * @param   header              Time, thread and level part of the record.
+         * @param   message             The message.
+         */
+        void writeRecord(const Level& level, const std::string& header, const std::string& message);
+        
+        /**
+         * @brief                       Adds a request to the queue of the I/O thread, starting the thread if needed.
+         * @param   request             The request, moved into the queue.
+         * @param   dropIfFull          true for fire-and-forget records, which are dropped if the queue is at its capacity.
+         * @return                      false if the request is dropped.
+         */
+        bool enqueueAsync(AsyncRequest& request, bool dropIfFull);
+        
+        /**
+         * @brief                       Body of the I/O thread. Writes the queued records in batches and syncs the file once per batch if a request needs it.
+         */
+        void asyncWriterThread();
+        
+        /**
+         * @brief                       Writes a batch of the I/O thread and runs its completions.
+         * @param   pWriter             Writer of the logger. The logger may be destroyed by a completion.
+         * @param   batch               Requests taken from the queue.
+         * @return                      false if the logger was destroyed by a completion.
+         */
+        bool writeAsyncBatch(AsyncWriter* pWriter, std::deque<AsyncRequest>& batch);
+        
+        /**
+         * @brief                       Stops the I/O thread after the queued requests are done. When it is called on the I/O thread,
+                                        the requests are done by the caller and the thread is detached.
+         */
+        void stopAsync();
+        
+        /**
+         * @brief                       Flushes the written records to the disk.
+         * @return                      RES_OK if successful, RES_FILE_ERROR otherwise.
+         */
+        Result syncFile();
+        
+        /**
+         * @brief                       Maps the control file of a shared log file and claims a writer slot for this process. Creates the control file if it does not exist.
+         * @return                      RES_OK if successful, RES_ERROR if all slots are used by running processes, RES_FILE_ERROR otherwise.
+         */
+        Result openShared();
+        
+        /**
+         * @brief                       Unmaps the control file and closes the descriptors of a shared log file.
+         */
+        void closeShared();
+        
+        /**
+         * @brief                       Appends a record to a shared log file with one write per line. Messages which do not fit into an atomic write
+         *                              are split into several lines, each with the same header.
+         * @param   header              Time, thread and level part of the record.
+         * @param   message             The message.
+         */
+        void writeShared(const std::string& header, const std::string& message);
+        
+        /**
+         * @brief                       Maps the ring file (m_path + ".ring"), creating and initializing it if it does not exist or is not a valid ring.
+         * @param   slotCount           Number of slots of a new ring, rounded up to a power of two. An existing ring keeps its geometry.
+         * @param   slotSize            Size of each slot of a new ring in bytes, including the slot header.
+         * @return                      RES_OK if successful, RES_FILE_ERROR otherwise.
+         */
+        Result openRing(size_t slotCount, size_t slotSize);
+        
+        /**
+         * @brief                       Unmaps the ring file.
+         */
+        void closeRing();
+        
+        /**
+         * @brief                       Copies a record into the next free slot of the ring without blocking. The record is dropped if the ring is full
+         *                              and the message is cut if it does not fit into a slot, both are counted in the ring.
+         * @param   level               The log level.
+         * @param   message             The message.
+         */
+        void pushRing(const Level& level, const std::string& message);
+        
+        /**
+         * @brief                       Gets the size of a shared log file from its control file.
+         * @return                      The size of the file.
+         */
+        size_t getSharedLogSize() const;
+        
+        /**
+         * @brief                       Truncates or rotates a shared log file under the exclusive lock of the control file, if no other process did it already.
+                                        If a running process does not finish its record within RW_SHARED_DRAIN_TIMEOUT_MS, the file is left as is and
+                                        this process tries again after the same time.
+         */
+        void maintainShared();
+        
     public:
         //Logger manager related types, methods and variables
         
         typedef std::shared_ptr<Logger> LogPtr;
         
+        /**
+         * @brief    Outcome of a log file write decided by the write hook, initialized to a successful write of the whole buffer.
+         */
+        struct WriteFault
+        {
+            unsigned            delayUs;                ///< Time the write takes before it returns, simulating a slow or stalled disk
+            size_t              size;                   ///< Bytes the write accepts, less than the requested size for a short write
+            int                 error;                  ///< errno the write fails with after accepting size bytes (e.g. ENOSPC), 0 for none
+        };
+        
+        typedef std::function<void(const std::string& path, size_t size, WriteFault& fault)> WriteHook;
+        
+        struct FileCacheStats
+        {
+            unsigned long long  hits;                   ///< Records written to a file which was already open
+            unsigned long long  misses;                 ///< Files opened, i.e. first records and records after an eviction, truncation or rotation
+            unsigned long long  evictions;              ///< Files closed to stay under the open file limit
+            unsigned long long  reclaimed;              ///< Idle loggers removed from the container
+            size_t              openFiles;              ///< Files currently open
+        };
+        
         /**
          * @brief                       Inits logging system and the console logger. If creation of file loggers, manager returns the console logger.
                                         This method is to be sure there is at least one logger object alive before proceeding any other logging operation.
@@ -227,6 +878,54 @@ namespace rw
          */
         static LogPtr getFileLogger(const std::string& filePath, const OverflowAction& overflowAction  = ACTION_TRUNCATE);
         
+        /**
+         * @brief                       Returns a file logger which can share its file with loggers of other processes.
+                                        Records are appended with O_APPEND, one write per line. Size and generation of the file are kept in a memory mapped
+                                        control file next to the log file (filePath + ".ctl") so that only one process truncates or rotates the file,
+                                        and the others reopen it by comparing the generation instead of checking the file for each record.
+                                        All processes are expected to use the same overflow action and maximum log size. Not supported on Windows, a regular file logger is returned.
+         * @param    filePath           Path to the file for logger to be initialized.
+         * @param    overflowAction     Action to be taken when file size exceeds maximum log size. Default action is truncation is to avoid inflation.
+         * @return                      Pointer to the file logger, console logger if cannot find and create logger or its control file cannot be created, mapped,
+                                        or has no free slot for this process. If a logger of the path already exists it is returned as is.
+         */
+        static LogPtr getSharedFileLogger(const std::string& filePath, const OverflowAction& overflowAction  = ACTION_TRUNCATE);
+        
+        /**
+         * @brief                       Returns a logger which does not touch the log file itself but copies records into a shared memory ring (filePath + ".ring").
+                                        A daemon process running serveRing for the same path writes the records to the file, so file I/O, truncation and rotation
+                                        are out of the calling process. Logging never blocks on the daemon, records are dropped when the ring is full.
+                                        Not supported on Windows, a regular file logger is returned.
+         * @param    filePath           Path to the file the daemon writes.
+         * @param    slotCount          Number of records the ring can hold, used only if the ring does not exist yet.
+         * @param    slotSize           Size of a ring slot in bytes, longer messages are cut. Used only if the ring does not exist yet.
+         * @return                      Pointer to the ring logger, console logger if cannot find and create logger. If a logger of the path already exists it is returned as is.
+         */
+        static LogPtr getRingLogger(const std::string& filePath, size_t slotCount = 4096, size_t slotSize = 512);
+        
+        /**
+         * @brief                       Consumes the ring of filePath and writes its records to filePath until stop is set. This is the body of the logging daemon.
+                                        The position of the daemon is kept in the ring, so a restarted daemon continues where the previous one stopped.
+                                        A record is released after it is written, so delivery is at least once: if the daemon dies between the two,
+                                        the next daemon writes that record again. Slots claimed by a producer which crashed before publishing its record
+                                        are skipped. A slot of a live producer which does not publish within RW_RING_PUBLISH_TIMEOUT_MS is skipped too,
+                                        but it is not reused until that producer is done with it.
+         * @param    filePath           Path to the log file, the ring is filePath + ".ring".
+         * @param    overflowAction     Action to be taken when file size exceeds maximum log size.
+         * @param    maxLogSize         The maximum size of log file.
+         * @param    stop               Checked between records. Once it is set serveRing drains the records claimed before and returns, later ones wait for the next daemon.
+         * @return                      RES_OK when stopped, RES_ERROR if another daemon is serving the ring, RES_FILE_ERROR if the ring cannot be mapped.
+         */
+        static Result serveRing(const std::string& filePath, const OverflowAction& overflowAction, size_t maxLogSize, const std::atomic<bool>& stop);
+        
+        /**
+         * @brief                       Removes a stale ring file, i.e. a ring which no running producer or daemon has mapped and which has no published record
+                                        left. Slots claimed by crashed producers are not pending records.
+         * @param    filePath           Path to the log file, the ring is filePath + ".ring".
+         * @return                      RES_OK if the ring is removed, RES_ERROR if it is in use or has pending records, RES_FILE_ERROR if it does not exist.
+         */
+        static Result removeRing(const std::string& filePath);
+        
         /**
          * @brief                       Removes a logger object from the container if exists.
                                         Console logger and default file logger cannot be removed.
@@ -243,6 +942,124 @@ namespace rw
          */
         static size_t getLoggerCount();
         
+        /**
+         * @brief                       Sets the maximum number of log files kept open by all file loggers together. Files of idle loggers are closed in least recently
+                                        used order and reopened by their next record. Lowering the limit closes files immediately.
+         * @param    maxOpenFiles       The maximum number of open files. 0 closes the file after each record.
+         */
+        static void setMaxOpenFiles(size_t maxOpenFiles);
+        
+        /**
+         * @brief                       Gets the maximum number of open log files.
+         * @return                      The maximum number of open files.
+         */
+        static size_t getMaxOpenFiles();
+        
+        /**
+         * @brief                       Gets the counters of the open file cache.
+         * @return                      Hit, miss, eviction and reclamation counts since the start of the process, and the number of open files.
+         */
+        static FileCacheStats getFileCacheStats();
+        
+        /**
+         * @brief                       Enables automatic removal of idle file loggers, i.e. loggers only referenced by the container. The container is swept when
+                                        it has doubled since the previous sweep. A removed logger is created again by the next getter call with default settings,
+                                        so it should be enabled only if loggers are configured each time they are retrieved. Disabled by default.
+         * @param    reclaim            true to enable.
+         */
+        static void setReclaimIdleLoggers(bool reclaim);
+        
+        /**
+         * @brief                       Removes idle loggers from the container now. Console and default loggers are never removed.
+         * @return                      Number of removed loggers.
+         */
+        static size_t reclaimIdleLoggers();
+        
+        /**
+         * @brief                       Installs a hook called before each write of a log file by file and shared file loggers, to test logging on a degraded disk.
+                                        A short write is continued by another write like a short write of the system. A failed write drops the rest of its record,
+                                        the next record starts on a new line. Writes of truncation and rotation are not hooked. Not meant for production use.
+         * @param    hook               The hook, an empty function removes it.
+         */
+        static void setWriteHook(const WriteHook& hook);
+        
+        //Category related methods
+        
+        /**
+         * @brief                       Returns the category with the given name, creates it if it does not exist.
+                                        Returned reference is valid until the process exits, statements are expected to retrieve it once and keep it.
+         * @param    name               Dot separated hierarchical name of the category, e.g. "net.http".
+         * @return                      The category.
+         */
+        static Category& getCategory(const std::string& name);
+        
+        /**
+         * @brief                       Configures the level of a category name. It applies to the category and its descendants which are not configured.
+         * @param    name               Category name, "*" configures all categories.
+         * @param    level              The log level.
+         */
+        static void setCategoryLevel(const std::string& name, Level level);
+        
+        /**
+         * @brief                       Removes the configured level of a category name, the category then follows its ancestors or the logger.
+         * @param    name               Category name.
+         */
+        static void resetCategoryLevel(const std::string& name);
+        
+        /**
+         * @brief                       Replaces all configured category levels with the ones in the given file.
+                                        Each line is "name = LEVEL" where LEVEL is ERROR, WARNING, NORMAL, DEBUG, INSANE or an integer. Lines starting with # are ignored.
+         * @param    configPath         Path to the configuration file.
+         * @return                      RES_OK if successful, RES_FILE_ERROR if the file cannot be read, RES_BAD_ARGS if a line cannot be parsed (nothing is applied).
+         */
+        static Result loadCategoryLevels(const std::string& configPath);
+        
+        /**
+         * @brief                       Starts a background thread which reloads the category levels whenever the content of the file changes.
+                                        Writers are never stopped, a reload only stores the new effective levels.
+                                        A running watcher is replaced.
+         * @param    configPath         Path to the configuration file.
+         * @param    pollIntervalMs     Interval in milliseconds between file checks.
+         * @return                      RES_OK if the watcher is started, RES_BAD_ARGS if the interval is zero.
+         */
+        static Result watchCategoryLevels(const std::string& configPath, unsigned pollIntervalMs = 1000);
+        
+        /**
+         * @brief                       Stops the category level watcher if it is running. Configured levels are kept.
+         */
+        static void stopWatchingCategoryLevels();
+        
+        //Call site related methods
+        
+        /**
+         * @brief                       Returns the call sites which logged the most bytes.
+         * @param    count              Maximum number of call sites to return, 0 for all of them.
+         * @return                      Call sites ordered by bytes, then by hits.
+         */
+        static std::vector<CallSiteStats> getTopCallSites(size_t count);
+        
+        /**
+         * @brief                       Writes the call sites which logged the most bytes as a table.
+         * @param    os                 Output stream.
+         * @param    count              Maximum number of call sites to write, 0 for all of them.
+         */
+        static void dumpTopCallSites(std::ostream& os, size_t count);
+        
+        /**
+         * @brief                       Enables or disables the statements at a source location. The setting is also applied to statements
+                                        which have not run yet when they run for the first time, the last call which matches a location wins.
+         * @param    file               End of the source file path, e.g. "main.cpp" or "net/http.cpp".
+         * @param    line               Line of the statement, 0 for all statements of the file.
+         * @param    enabled            false to drop the records of the statements.
+         * @return                      Number of registered call sites which are changed.
+         */
+        static size_t setCallSiteEnabled(const std::string& file, int line, bool enabled);
+        
+        /**
+         * @brief                       Sets the counters of all call sites to zero.
+         */
+        static void resetCallSiteCounters();
+        
     private:
         typedef std::unordered_map<std::string, LogPtr> LoggerContainer;
         
@@ -251,6 +1068,76 @@ namespace rw
                                                                                         ///< Console logger has a file name of "", default logger has a file name of "rw_default_log.txt".
         static const std::string    defaultLoggerFilePath;                              ///< Default path to logger object
         static const std::string    consoleLoggerFilePath;                              ///< Path to console logger object
+        static bool                 m_reclaimIdleLoggers;                               ///< Enables sweeping idle loggers, protected by m_managerMutex
+        static size_t               m_reclaimWatermark;                                 ///< Container size which triggers the next sweep
+        
+        typedef std::list<Logger*> FileCacheList;
+        
+        static std::mutex           m_fileCacheMutex;                                   ///< Protects the open file list and the counters, taken after a m_logMutex, never before
+        static FileCacheList        m_openFiles;                                        ///< Loggers with open files, most recently used first
+        static std::atomic<size_t>  m_maxOpenFiles;                                     ///< Open file limit
+        static FileCacheStats       m_fileCacheStats;                                   ///< Counters of the open file cache, hits of open files are kept by their loggers
+        static std::atomic<unsigned long long> m_fileCacheClock;                        ///< Incremented when a file is opened, use stamps are copied from it
+        
+        friend class LogReader;
+        
+        /**
+         * @brief                       Wakes up the readers waiting in LogReader::wait. Called after a record is written if m_writeWaiters is not zero.
+         */
+        static void notifyWrite();
+        
+        static std::mutex               m_writeNotifyMutex;                             ///< Protects m_writeSequence
+        static std::condition_variable  m_writeNotifyCond;                              ///< Signalled by notifyWrite
+        static std::atomic<int>         m_writeWaiters;                                 ///< Number of waiting readers, records are not notified without them
+        static unsigned long long       m_writeSequence;                                ///< Incremented by notifyWrite
+        
+        static std::mutex               m_writeHookMutex;                               ///< Protects m_writeHook
+        static WriteHook                m_writeHook;                                    ///< Fault injection hook of log file writes
+        static std::atomic<bool>        m_hasWriteHook;                                 ///< Checked by writers before taking m_writeHookMutex
+        
+        typedef std::map<std::string, std::unique_ptr<Category> > CategoryContainer;
+        typedef std::map<std::string, int> CategoryLevelContainer;
+        
+        //Background thread polling a category configuration file
+        struct CategoryWatcher
+        {
+            std::mutex              controlMutex;               ///< Serializes starting and stopping, held while the thread is joined
+            std::mutex              mutex;
+            std::condition_variable cond;
+            std::thread             thread;
+            bool                    stop = false;
+            
+            ~CategoryWatcher();
+        };
+        
+        /**
+         * @brief                       Resolves the effective level of every category from m_categoryLevels. m_categoryMutex must be held.
+         */
+        static void resolveCategoryLevels();
+        static void categoryWatcherThread(std::string configPath, unsigned pollIntervalMs);
+        
+        /**
+         * @brief                       Stops and joins the watcher thread if it runs. m_categoryWatcher.controlMutex must be held.
+         */
+        static void stopCategoryWatcher();
+        
+        static std::mutex               m_categoryMutex;                                ///< Protects category containers, never taken by writers
+        static CategoryContainer        m_categories;                                   ///< Categories by name, never removed so that statements can keep references
+        static CategoryLevelContainer   m_categoryLevels;                               ///< Configured levels by category name
+        static CategoryWatcher          m_categoryWatcher;                              ///< Must be defined after the containers to be destructed before them
+        
+        struct CallSiteRule
+        {
+            std::string             file;
+            int                     line;
+            bool                    enabled;
+        };
+        
+        static bool matchCallSite(const CallSite& site, const std::string& file, int line);
+        
+        static std::atomic<CallSite*>   m_callSites;                                    ///< Head of the call site registry, sites are only added
+        static std::mutex               m_callSiteMutex;                                ///< Protects m_callSiteRules
+        static std::vector<CallSiteRule> m_callSiteRules;                               ///< Settings of setCallSiteEnabled, applied to new sites
     };
 }
 
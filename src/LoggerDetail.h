@@ -0,0 +1,191 @@
+//
+//  LoggerDetail.h
+//  rwlogger
+//
+//  Created by Tayfun Ateş on 8.02.2019.
+//  Copyright © 2019 Tayfun Ateş. All rights reserved.
+//
+
+#ifndef LoggerDetail_h
+#define LoggerDetail_h
+
+#include "Logger.h"
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <ctime>
+#include <thread>
+
+#define RW_DEFAULT_MAX_LOG_LENGTH    (1024*1024)        // Maximum log size of new loggers
+#define RW_MIN_LOG_LENGTH            512                // Smallest maximum log size and smallest size kept by a truncation
+
+//Record format and log file helpers of Logger and BasicLogger
+
+namespace rw
+{
+    namespace detail
+    {
+        /**
+         * @brief    Returns the three letter tag of a level written in record headers.
+         * @param    level                       Level of the record
+         * @return   Tag of the level
+         */
+        inline std::string getLogLevelString(const Logger::Level& level)
+        {
+            if (level==Logger::LOG_LEVEL_ERROR) return std::string("ERR");
+            else if (level==Logger::LOG_LEVEL_WARNING) return std::string("WRN");
+            else if (level==Logger::LOG_LEVEL_DEBUG) return std::string("DBG");
+            else return std::string("   ");
+        }
+        
+        /**
+         * @brief    Formats a time point as "[YYYY-MM-DD-hh-mm-ss-mmm]" in local time.
+         * @param    now                         Time to format
+         * @return   Formatted time
+         */
+        inline std::string getTimeAndDateString(const std::chrono::system_clock::time_point& now)
+        {
+            std::chrono::system_clock::duration tp = now.time_since_epoch();
+            tp -= std::chrono::duration_cast<std::chrono::seconds>(tp);
+            time_t tt = std::chrono::system_clock::to_time_t(now);
+            
+#ifdef _MSC_VER
+            tm t;
+            localtime_s(&t, &tt);
+#else
+            //Headers are formatted outside of any lock, localtime shares its result between threads
+            tm t;
+            localtime_r(&tt, &t);
+#endif
+            
+            char buff[30];
+            snprintf(buff, sizeof(buff), "[%04u-%02u-%02u-%02u-%02u-%02u-%03u]", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, static_cast<unsigned>(tp / std::chrono::milliseconds(1)));
+            
+            return std::string(buff);
+        }
+        
+        inline std::string getTimeAndDateString()
+        {
+            return getTimeAndDateString(std::chrono::system_clock::now());
+        }
+        
+        inline std::string formatThreadIDString()
+        {
+            auto threadId = std::this_thread::get_id();
+            
+#ifdef _MSC_VER
+            uint64_t n=0;
+            std::stringstream ss;
+            ss << threadId;
+            ss >> std::dec >> n;
+            ss = std::stringstream();
+            ss << std::setw(16) << std::setfill('0') << std::hex << n;
+#else
+            std::stringstream ss;
+            ss << std::setw(16) << std::setfill('0') << threadId;
+#endif
+            return std::string(ss.str());
+        }
+        
+        // Thread id of the caller, formatted once per thread
+        inline const std::string& getThreadIDString()
+        {
+            thread_local const std::string threadIdString = formatThreadIDString();
+            return threadIdString;
+        }
+        
+        /**
+         * @brief    Builds the "<time> <thread id> <level>| " header of a record.
+         * @param    time                        Time of the record
+         * @param    threadId                    Formatted id of the writing thread
+         * @param    level                       Level of the record
+         * @return   Header of the record
+         */
+        inline std::string getRecordHeader(const std::chrono::system_clock::time_point& time, const std::string& threadId, const Logger::Level& level)
+        {
+            std::string header = getTimeAndDateString(time);
+            header.reserve(header.size() + threadId.size() + 7);
+            header.append(" ").append(threadId).append(" ").append(getLogLevelString(level)).append("| ");
+            return header;
+        }
+        
+        /**
+         * @brief    Builds the header of a record written now by the calling thread.
+         * @param    level                       Level of the record
+         * @return   Header of the record
+         */
+        inline std::string formatRecordHeader(const Logger::Level& level)
+        {
+            return getRecordHeader(std::chrono::system_clock::now(), getThreadIDString(), level);
+        }
+        
+        /**
+         * @brief    Returns a not yet existing path which a log file at path can be rotated to.
+         * @param    path                        Path of the log file
+         * @return   Path of the rotated file
+         */
+        inline std::string getRotatedFilePath(const std::string& path)
+        {
+            std::string timeStr = getTimeAndDateString();
+            std::string newFileName(path+"_"+timeStr+".log");
+            
+            //Several rotations in a millisecond are possible when processes share the file, do not overwrite the previous one
+            for(int i = 1; std::ifstream(newFileName.c_str()).is_open(); i++) {
+                newFileName = path+"_"+timeStr+"_"+std::to_string(i)+".log";
+            }
+            return newFileName;
+        }
+        
+        /**
+         * @brief    Keeps the last newLen bytes of the file at path, cut at a line boundary. Shorter files are not changed.
+         * @param    path                        Path of the log file
+         * @param    newLen                      Number of bytes to keep
+         * @return   True if the file could be truncated
+         */
+        inline bool truncateFile(const std::string& path, size_t newLen)
+        {
+            std::fstream inFile;
+            inFile.open( path.c_str(), std::ios::in | std::ios::binary );
+            if(inFile.is_open())
+            {
+                //A file which is not longer than newLen is kept as is, seeking before its beginning would empty it
+                inFile.seekg(0, std::ios::end);
+                if(static_cast<size_t>(inFile.tellg()) <= newLen) {
+                    return true;
+                }
+                inFile.seekp(-int(newLen), std::ios::end );
+                std::string timeStr = getTimeAndDateString();
+                
+                std::fstream tempFile;
+                std::string tempFileName(path+"_"+timeStr+".log");
+                
+                tempFile.open( tempFileName.c_str(), std::ios::out | std::ios::binary );
+                if(tempFile.is_open())
+                {
+                    std::string line;
+                    while(std::getline(inFile, line))
+                    {
+                        if(line.length()>0) {
+                            tempFile << line << std::endl;
+                        }
+                    }
+                    tempFile.close();
+                }
+                
+                //rename
+                inFile.close();
+                remove(path.c_str());
+                rename(tempFileName.c_str(), path.c_str());
+                
+                return true;
+            }
+            return false;
+        }
+    }
+}
+
+#endif /* LoggerDetail_h */
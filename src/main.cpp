@@ -8,11 +8,34 @@
 
 #include <iostream>
 #include "Logger.h"
+#include "BasicLogger.h"
+#include "LogReader.h"
+#include "LogScanner.h"
 #include <fstream>
 #include <thread>
 #include <chrono>
 #include <iomanip>
+#include <climits>
+#include <string>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <assert.h>
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
 
 using namespace rw;
 
@@ -125,6 +148,1104 @@ void TEST_userDefinedTypes()
     remove(testFile.c_str());
 }
 
+std::string getLastLogMessage(const std::string& filePath)
+{
+    const size_t headerSize = 48; //"[time] threadid LVL| "
+    std::ifstream inFile(filePath.c_str());
+    std::string line, last;
+    while(std::getline(inFile, line)) {
+        last = line;
+    }
+    return last.size() >= headerSize ? last.substr(headerSize) : std::string();
+}
+
+void TEST_numberFormatting()
+{
+    const std::string testFile = "TEST_numberFormatting.log";
+    auto customLogger = Logger::getFileLogger(testFile, Logger::ACTION_NONE);
+    
+    //Integers must match the stream output exactly, including when flags are changed in the middle of a statement
+    std::ostringstream expected;
+    expected << 0 << " " << -1 << " " << INT_MIN << " " << LLONG_MIN << " " << ULLONG_MAX << " " << (short)-5 << " " << (unsigned short)65535
+             << " " << std::setw(4) << std::setfill('0') << 42 << " " << std::hex << -42 << std::dec << " " << 1234567890123ll << " " << 3.14159265 << " " << 1e-7;
+    customLogger->operator()(Logger::LOG_LEVEL_WARNING) << 0 << " " << -1 << " " << INT_MIN << " " << LLONG_MIN << " " << ULLONG_MAX << " " << (short)-5 << " " << (unsigned short)65535
+             << " " << std::setw(4) << std::setfill('0') << 42 << " " << std::hex << -42 << std::dec << " " << 1234567890123ll << " " << 3.14159265 << " " << 1e-7;
+    assert(getLastLogMessage(testFile) == expected.str());
+    
+    //Shortest round trip output for floating point values
+    customLogger->setFloatFormat(Logger::FLOAT_FORMAT_SHORTEST);
+    customLogger->operator()(Logger::LOG_LEVEL_WARNING) << 0.1 << " " << 3.141592653589793 << " " << 1e21 << " " << 0.3f << " " << -0.0 << " " << 5e-324 << " " << 100.0;
+    assert(getLastLogMessage(testFile) == "0.1 3.141592653589793 1e+21 0.3 -0 5e-324 100");
+    
+    //Stream flags still have the priority
+    customLogger->operator()(Logger::LOG_LEVEL_WARNING) << std::fixed << std::setprecision(3) << 0.1;
+    assert(getLastLogMessage(testFile) == "0.100");
+    
+    Logger::destroy(testFile);
+    remove(testFile.c_str());
+}
+
+void TEST_categoryLevels()
+{
+    const std::string testFile = "TEST_categoryLevels.log";
+    const std::string configFile = "TEST_categoryLevels.cfg";
+    const std::string debugMessage = "Debug Message";
+    
+    auto customLogger = Logger::getFileLogger(testFile);
+    Logger::Category& http = Logger::getCategory("net.http");
+    Logger::Category& db = Logger::getCategory("db");
+    
+    //Categories follow the logger level unless they are configured
+    LOGF_CAT(Logger::LOG_LEVEL_DEBUG, testFile, http) << debugMessage;
+    assert(getFileSize(testFile) == 0);
+    
+    //Configuring the parent enables the child but not the other categories
+    Logger::setCategoryLevel("net", Logger::LOG_LEVEL_DEBUG);
+    LOGF_CAT(Logger::LOG_LEVEL_DEBUG, testFile, db) << debugMessage;
+    assert(getFileSize(testFile) == 0);
+    LOGF_CAT(Logger::LOG_LEVEL_DEBUG, testFile, http) << debugMessage;
+    assert(getLastLogMessage(testFile) == debugMessage);
+    
+    //Levels are reloaded from the configuration file while the logger is in use
+    {
+        std::ofstream config(configFile.c_str());
+        config << "# levels" << std::endl << "net.http = ERROR" << std::endl << "db=DEBUG" << std::endl;
+    }
+    assert(Logger::watchCategoryLevels(configFile, 10) == Logger::RES_OK);
+    for(int i=0; i < 500 && customLogger->isLogged(Logger::LOG_LEVEL_WARNING, &http); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    Logger::stopWatchingCategoryLevels();
+    
+    //Concurrent restarts replace the watcher one by one
+    std::vector<std::thread> restarters;
+    for(int i=0; i < 4; i++) {
+        restarters.push_back(std::thread([&configFile]() { for(int j=0; j < 20; j++) Logger::watchCategoryLevels(configFile, 10); }));
+    }
+    for(size_t i=0; i < restarters.size(); i++) {
+        restarters[i].join();
+    }
+    Logger::stopWatchingCategoryLevels();
+    
+    const size_t size = getFileSize(testFile);
+    customLogger->operator()(Logger::LOG_LEVEL_WARNING, http) << debugMessage;
+    assert(getFileSize(testFile) == size);
+    customLogger->operator()(Logger::LOG_LEVEL_DEBUG, db) << debugMessage;
+    assert(getFileSize(testFile) > size);
+    
+    //Uncategorized statements are not affected
+    const size_t sizeBeforeUncategorized = getFileSize(testFile);
+    customLogger->operator()(Logger::LOG_LEVEL_DEBUG) << debugMessage;
+    assert(getFileSize(testFile) == sizeBeforeUncategorized);
+    
+    Logger::resetCategoryLevel("net.http");
+    Logger::resetCategoryLevel("db");
+    Logger::destroy(testFile);
+    remove(testFile.c_str());
+    remove(configFile.c_str());
+}
+
+void TEST_basicLogger()
+{
+    const std::string testFile = "TEST_basicLogger.log";
+    const std::string message = "abc";
+    const size_t recordSize = 48 + 3 + 1;
+    
+    //Single threaded logger writes the same records as Logger
+    {
+        SingleThreadedFileLogger logger(testFile);
+        logger(Logger::LOG_LEVEL_DEBUG) << message;
+        assert(getFileSize(testFile) == 0);
+        logger(Logger::LOG_LEVEL_WARNING) << message;
+        assert(getFileSize(testFile) == recordSize);
+        assert(getLastLogMessage(testFile) == message);
+    }
+    remove(testFile.c_str());
+    
+    //Spin lock keeps records of several threads intact
+    {
+        const int numberOfThreads = 4;
+        const int numberOfRecords = 200;
+        SpinLockFileLogger logger(testFile);
+        std::vector<std::thread> threads;
+        for(int t=0; t < numberOfThreads; t++) {
+            threads.push_back(std::thread([&logger, &message]() {
+                for(int i=0; i < numberOfRecords; i++) {
+                    logger(Logger::LOG_LEVEL_NORMAL) << message;
+                }
+            }));
+        }
+        for(size_t t=0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+        assert(getFileSize(testFile) == recordSize*numberOfThreads*numberOfRecords);
+    }
+    remove(testFile.c_str());
+    
+    //Truncation bounds the file size
+    {
+        const size_t maxSize = 2048;
+        SingleThreadedFileLogger logger(testFile);
+        assert(logger.getMaxLogSize() == 1024*1024);
+        logger.setMaxLogSize(100);
+        assert(logger.getMaxLogSize() == 512);
+        logger.setMaxLogSize(maxSize);
+        for(int i=0; i < 200; i++) {
+            logger(Logger::LOG_LEVEL_ERROR) << std::string(100, 'a');
+            assert(getFileSize(testFile) <= maxSize + 48 + 101);
+        }
+    }
+    remove(testFile.c_str());
+}
+
+#ifndef _MSC_VER
+void sharedWriterProcess(const std::string& testFile, Logger::OverflowAction action, size_t maxSize, int loopCount)
+{
+    auto sharedLogger = Logger::getSharedFileLogger(testFile, action);
+    sharedLogger->setMaxLogSize(maxSize);
+    for (int i=0;i<loopCount;++i)
+    {
+        sharedLogger->operator()(Logger::LOG_LEVEL_ERROR) << std::setw(2) << std::setfill('0') << i % 100;
+    }
+}
+
+void sharedLongWriterProcess(const std::string& testFile, char fill, size_t messageSize, int loopCount)
+{
+    auto sharedLogger = Logger::getSharedFileLogger(testFile, Logger::ACTION_NONE);
+    const std::string message(messageSize, fill);
+    for (int i=0;i<loopCount;++i)
+    {
+        sharedLogger->operator()(Logger::LOG_LEVEL_ERROR) << message;
+    }
+}
+
+void TEST_multiProcessSharedFile()
+{
+    const std::string testFile = "TEST_multiProcessSharedFile";
+    const int processCnt = 4;
+    const int loopCount = 200;
+    const size_t maxSize = 4096;
+    const size_t expectedLineSize = 51;
+    const Logger::OverflowAction actions[] = { Logger::ACTION_NONE, Logger::ACTION_ROTATE, Logger::ACTION_TRUNCATE };
+    
+    for (Logger::OverflowAction action : actions)
+    {
+        pid_t pids[processCnt];
+        for ( int i=0;i<processCnt;++i)
+        {
+            pids[i] = fork();
+            assert(pids[i] >= 0);
+            if(pids[i] == 0)
+            {
+                sharedWriterProcess(testFile, action, maxSize, loopCount);
+                _exit(0);
+            }
+        }
+        for ( int i=0;i<processCnt;++i)
+        {
+            int status = 0;
+            waitpid(pids[i], &status, 0);
+            assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+        
+        //No record is torn, neither in the log file nor in the rotated files. Truncation only cuts the first line of the file.
+        size_t totalSize = 0;
+        size_t fileCount = 0;
+        DIR* pDir = opendir(".");
+        assert(pDir);
+        while(dirent* pEntry = readdir(pDir))
+        {
+            const std::string name = pEntry->d_name;
+            if(name != testFile && name.compare(0, testFile.size() + 1, testFile + "_") != 0) continue;
+            std::ifstream inFile(name.c_str());
+            std::string line;
+            for(bool first = true; std::getline(inFile, line); first = false) {
+                assert(line.size() + 1 == expectedLineSize || (first && action == Logger::ACTION_TRUNCATE && line.size() + 1 < expectedLineSize));
+            }
+            totalSize += getFileSize(name);
+            fileCount++;
+            remove(name.c_str());
+        }
+        closedir(pDir);
+        remove((testFile + ".ctl").c_str());
+        
+        //Rotation keeps every record, truncation keeps the file under twice the maximum size
+        if(action == Logger::ACTION_TRUNCATE)
+        {
+            assert(fileCount == 1 && totalSize <= 2 * maxSize);
+        }
+        else
+        {
+            assert(totalSize == processCnt * loopCount * expectedLineSize);
+            assert(action == Logger::ACTION_NONE ? fileCount == 1 : fileCount > 1);
+        }
+    }
+    
+    //Children forked after the logger was created lock the control file on their own, rotations of the processes do not overlap
+    const size_t forkMaxSize = 512;
+    const int forkLoopCount = 2000;
+    for (Logger::OverflowAction action : actions)
+    {
+        auto sharedLogger = Logger::getSharedFileLogger(testFile, action);
+        sharedLogger->setMaxLogSize(forkMaxSize);
+        sharedLogger->operator()(Logger::LOG_LEVEL_ERROR) << "00";
+        pid_t pids[processCnt];
+        for ( int i=0;i<processCnt;++i)
+        {
+            pids[i] = fork();
+            assert(pids[i] >= 0);
+            if(pids[i] == 0)
+            {
+                for (int j=0;j<forkLoopCount;++j) {
+                    sharedLogger->operator()(Logger::LOG_LEVEL_ERROR) << std::setw(2) << std::setfill('0') << j % 100;
+                }
+                _exit(0);
+            }
+        }
+        for (int j=1;j<forkLoopCount;++j) {
+            sharedLogger->operator()(Logger::LOG_LEVEL_ERROR) << std::setw(2) << std::setfill('0') << j % 100;
+        }
+        for ( int i=0;i<processCnt;++i)
+        {
+            int status = 0;
+            waitpid(pids[i], &status, 0);
+            assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+        sharedLogger.reset();
+        Logger::destroy(testFile);
+        
+        size_t totalSize = 0;
+        size_t fileCount = 0;
+        DIR* pDir = opendir(".");
+        assert(pDir);
+        while(dirent* pEntry = readdir(pDir))
+        {
+            const std::string name = pEntry->d_name;
+            if(name != testFile && name.compare(0, testFile.size() + 1, testFile + "_") != 0) continue;
+            std::ifstream inFile(name.c_str());
+            std::string line;
+            for(bool first = true; std::getline(inFile, line); first = false) {
+                assert(line.size() + 1 == expectedLineSize || (first && action == Logger::ACTION_TRUNCATE && line.size() + 1 < expectedLineSize));
+            }
+            totalSize += getFileSize(name);
+            fileCount++;
+            remove(name.c_str());
+        }
+        closedir(pDir);
+        remove((testFile + ".ctl").c_str());
+        
+        if(action == Logger::ACTION_TRUNCATE)
+        {
+            assert(fileCount == 1 && totalSize <= 2 * forkMaxSize);
+        }
+        else
+        {
+            assert(totalSize == (processCnt + 1) * forkLoopCount * expectedLineSize);
+        }
+    }
+    
+    //Truncation is based on the real file size, a file shorter than the shared size suggests is not emptied
+    {
+        auto sharedLogger = Logger::getSharedFileLogger(testFile, Logger::ACTION_TRUNCATE);
+        sharedLogger->setMaxLogSize(maxSize);
+        for (int i=0;i<70;++i) {
+            sharedLogger->operator()(Logger::LOG_LEVEL_ERROR) << std::setw(2) << std::setfill('0') << i;
+        }
+        assert(::truncate(testFile.c_str(), 3 * expectedLineSize) == 0);
+        for (int i=0;i<20;++i) {
+            sharedLogger->operator()(Logger::LOG_LEVEL_ERROR) << std::setw(2) << std::setfill('0') << i;
+        }
+        assert(getFileSize(testFile) == 23 * expectedLineSize);
+        assert(getLastLogMessage(testFile) == "19");
+        sharedLogger.reset();
+        Logger::destroy(testFile);
+        remove(testFile.c_str());
+        remove((testFile + ".ctl").c_str());
+    }
+    
+    //Messages longer than an atomic write are split into lines of the same header, lines of the processes do not mix
+    const size_t messageSize = 2 * PIPE_BUF + 100;
+    const size_t headerSize = 48;
+    const int longLoopCount = 20;
+    pid_t pids[processCnt];
+    for ( int i=0;i<processCnt;++i)
+    {
+        pids[i] = fork();
+        assert(pids[i] >= 0);
+        if(pids[i] == 0)
+        {
+            sharedLongWriterProcess(testFile, static_cast<char>('a' + i), messageSize, longLoopCount);
+            _exit(0);
+        }
+    }
+    for ( int i=0;i<processCnt;++i)
+    {
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    
+    size_t bodySizes[processCnt] = {};
+    std::ifstream inFile(testFile.c_str());
+    std::string line;
+    while(std::getline(inFile, line))
+    {
+        assert(line.size() + 1 <= PIPE_BUF && line.size() > headerSize);
+        const char fill = line[headerSize];
+        assert(fill >= 'a' && fill < 'a' + processCnt);
+        assert(line.find_first_not_of(fill, headerSize) == std::string::npos);
+        bodySizes[fill - 'a'] += line.size() - headerSize;
+    }
+    for ( int i=0;i<processCnt;++i)
+    {
+        assert(bodySizes[i] == longLoopCount * messageSize);
+    }
+    inFile.close();
+    remove(testFile.c_str());
+    remove((testFile + ".ctl").c_str());
+}
+#endif
+
+#ifndef _MSC_VER
+void TEST_ringTransport()
+{
+    const std::string testFile = "TEST_ringTransport";
+    const int threadCnt = 4;
+    const size_t expectedLineSize = 51;
+    std::atomic<bool> stop(false);
+    
+    auto ringLogger = Logger::getRingLogger(testFile, 1024);
+    
+    //Records logged while no daemon is running wait in the ring
+    for ( int i=0;i<100;++i)
+    {
+        ringLogger->operator()(Logger::LOG_LEVEL_ERROR) << std::setw(2) << std::setfill('0') << i;
+    }
+    assert(getFileSize(testFile) == 0);
+    
+    std::thread daemon([&]() { assert(Logger::serveRing(testFile, Logger::ACTION_NONE, 1024*1024, stop) == Logger::RES_OK); });
+    std::thread* threads[threadCnt];
+    for ( int i=0;i<threadCnt;++i)
+    {
+        threads[i] = new std::thread( [&]() {
+            for (int j=0;j<100;++j)
+            {
+                ringLogger->operator()(Logger::LOG_LEVEL_ERROR) << std::setw(2) << std::setfill('0') << j;
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+    }
+    for ( int i=0;i<threadCnt;++i)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+    
+    //The daemon drains the ring before it stops
+    stop = true;
+    daemon.join();
+    assert(getFileSize(testFile) == (threadCnt + 1) * 100 * expectedLineSize);
+    
+    //A restarted daemon continues where the previous one stopped, each record is written once
+    for ( int i=0;i<100;++i)
+    {
+        ringLogger->operator()(Logger::LOG_LEVEL_ERROR) << std::setw(2) << std::setfill('0') << i;
+    }
+    assert(Logger::serveRing(testFile, Logger::ACTION_NONE, 1024*1024, stop) == Logger::RES_OK);
+    assert(getFileSize(testFile) == (threadCnt + 2) * 100 * expectedLineSize);
+    
+    //A daemon stops under steady load, the records left behind are written by the next one. Slow writes keep the ring full.
+    Logger::setWriteHook([&testFile](const std::string& path, size_t, Logger::WriteFault& fault) {
+        if(path == testFile) fault.delayUs = 100;
+    });
+    std::atomic<bool> loadStop(false);
+    std::atomic<bool> served(false);
+    std::thread loadedDaemon([&]() {
+        assert(Logger::serveRing(testFile, Logger::ACTION_NONE, 1024*1024, loadStop) == Logger::RES_OK);
+        served = true;
+    });
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    for ( int i=0;i<threadCnt;++i)
+    {
+        threads[i] = new std::thread( [&]() {
+            for (int j=0; !served.load() && std::chrono::steady_clock::now() < deadline; ++j) {
+                ringLogger->operator()(Logger::LOG_LEVEL_ERROR) << std::setw(2) << std::setfill('0') << j % 100;
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    loadStop = true;
+    for ( int i=0;i<threadCnt;++i)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+    assert(served.load());
+    loadedDaemon.join();
+    Logger::setWriteHook(Logger::WriteHook());
+    assert(Logger::serveRing(testFile, Logger::ACTION_NONE, 1024*1024, stop) == Logger::RES_OK);
+    
+    //A ring which is still mapped by a producer is in use
+    Logger::destroy(testFile);
+    assert(Logger::removeRing(testFile) == Logger::RES_ERROR);
+    
+    //A ring with a stopped daemon, no producer and no pending record is stale
+    ringLogger.reset();
+    assert(Logger::removeRing(testFile) == Logger::RES_OK);
+    remove(testFile.c_str());
+}
+
+//Beginning of the ring file layout of Logger.cpp, used to simulate a producer which crashes between claiming and publishing a slot
+struct TestRingHeader
+{
+    uint32_t                magic;
+    uint32_t                slotCount;
+    uint32_t                slotSize;
+    uint32_t                reserved;
+    std::atomic<uint64_t>   head;
+};
+
+void crashingRingProducer(const std::string& testFile)
+{
+    const size_t ringHeaderSize = 128;
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if(pid == 0)
+    {
+        auto ringLogger = Logger::getRingLogger(testFile, 16);
+        const int fd = open((testFile + ".ring").c_str(), O_RDWR);
+        struct stat st;
+        fstat(fd, &st);
+        char* pMap = static_cast<char*>(mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        TestRingHeader* pHeader = reinterpret_cast<TestRingHeader*>(pMap);
+        const uint64_t position = pHeader->head.fetch_add(1);
+        char* pSlot = pMap + ringHeaderSize + (position & (pHeader->slotCount - 1)) * pHeader->slotSize;
+        reinterpret_cast<std::atomic<int64_t>*>(pSlot + 8)->store(getpid());
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+void TEST_ringRecovery()
+{
+    const std::string testFile = "TEST_ringRecovery";
+    const size_t expectedLineSize = 51;
+    
+    //The slot of a crashed producer is skipped without waiting for the publish timeout
+    crashingRingProducer(testFile);
+    auto ringLogger = Logger::getRingLogger(testFile, 16);
+    for ( int i=0;i<10;++i)
+    {
+        ringLogger->operator()(Logger::LOG_LEVEL_ERROR) << std::setw(2) << std::setfill('0') << i;
+    }
+    std::atomic<bool> stop(false);
+    std::thread daemon([&]() { assert(Logger::serveRing(testFile, Logger::ACTION_NONE, 1024*1024, stop) == Logger::RES_OK); });
+    for(int i=0; i < 200 && getFileSize(testFile) < 10 * expectedLineSize; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    stop = true;
+    daemon.join();
+    assert(getFileSize(testFile) == 10 * expectedLineSize);
+    
+    //Without a daemon, the slot of a crashed producer does not keep the ring from being removed
+    Logger::destroy(testFile);
+    ringLogger.reset();
+    crashingRingProducer(testFile);
+    assert(Logger::removeRing(testFile) == Logger::RES_OK);
+    remove(testFile.c_str());
+}
+#endif
+
+void TEST_fileCache()
+{
+    const std::string testFiles[] = { "TEST_fileCache_0.log", "TEST_fileCache_1.log", "TEST_fileCache_2.log" };
+    const std::string message = "Message";
+    const size_t maxOpenFiles = Logger::getMaxOpenFiles();
+    
+    Logger::setMaxOpenFiles(2);
+    const Logger::FileCacheStats before = Logger::getFileCacheStats();
+    for(int i=0; i < 3; i++) {
+        Logger::getFileLogger(testFiles[i], Logger::ACTION_NONE)->operator()(Logger::LOG_LEVEL_NORMAL) << message;
+    }
+    Logger::getFileLogger(testFiles[2], Logger::ACTION_NONE)->operator()(Logger::LOG_LEVEL_NORMAL) << message;
+    
+    //The least recently used file is closed, the others are reused
+    Logger::FileCacheStats stats = Logger::getFileCacheStats();
+    assert(stats.misses - before.misses == 3);
+    assert(stats.hits - before.hits == 1);
+    assert(stats.evictions - before.evictions == 1);
+    assert(stats.openFiles <= 2);
+    
+    //Evicted file is reopened by the next record
+    Logger::getFileLogger(testFiles[0], Logger::ACTION_NONE)->operator()(Logger::LOG_LEVEL_NORMAL) << message;
+    assert(Logger::getFileCacheStats().misses - before.misses == 4);
+    assert(getLastLogMessage(testFiles[0]) == message);
+    assert(getFileSize(testFiles[0]) == getFileSize(testFiles[2]));
+    
+#ifndef _MSC_VER
+    //A cached file which is moved away by another program is reopened at its path
+    const std::string movedFile = testFiles[0] + ".moved";
+    assert(rename(testFiles[0].c_str(), movedFile.c_str()) == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    Logger::getFileLogger(testFiles[0], Logger::ACTION_NONE)->operator()(Logger::LOG_LEVEL_NORMAL) << "reopened";
+    assert(getLastLogMessage(testFiles[0]) == "reopened");
+    assert(getLastLogMessage(movedFile) == message);
+    remove(movedFile.c_str());
+#endif
+    
+    Logger::setMaxOpenFiles(0);
+    assert(Logger::getFileCacheStats().openFiles == 0);
+    
+    //Loggers which are only referenced by the container are reclaimed
+    const size_t loggerCount = Logger::getLoggerCount();
+    Logger::LogPtr kept = Logger::getFileLogger(testFiles[1]);
+    assert(Logger::reclaimIdleLoggers() >= 2);
+    assert(Logger::getLoggerCount() < loggerCount);
+    assert(Logger::getFileLogger(testFiles[1]) == kept);
+    
+    Logger::setMaxOpenFiles(maxOpenFiles);
+    for(int i=0; i < 3; i++) {
+        Logger::destroy(testFiles[i]);
+        remove(testFiles[i].c_str());
+    }
+}
+
+void TEST_logReader()
+{
+    const std::string testFile = "TEST_logReader";
+    const std::string longString = std::string(150, 'a');
+    std::vector<LogReader::Record> records;
+    
+    //Records written before the reader are skipped, levels and messages are parsed
+    auto customLogger = Logger::getFileLogger(testFile, Logger::ACTION_TRUNCATE);
+    customLogger->operator()(Logger::LOG_LEVEL_NORMAL) << "old";
+    LogReader reader(testFile);
+    assert(reader.poll(records) == 0);
+    customLogger->operator()(Logger::LOG_LEVEL_ERROR) << "new";
+    assert(reader.poll(records) == 1);
+    assert(records[0].level == Logger::LOG_LEVEL_ERROR && records[0].getMessage() == "new");
+    
+    //Waiting reader is woken up by the write
+    std::thread writer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        customLogger->operator()(Logger::LOG_LEVEL_WARNING) << "woken";
+    });
+    records.clear();
+    const auto start = std::chrono::steady_clock::now();
+    assert(reader.wait(records, 10000) == 1);
+    assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    assert(records[0].getMessage() == "woken");
+    writer.join();
+    
+#ifndef _MSC_VER
+    //Every record is returned once across truncations and rotations
+    for(int action = Logger::ACTION_TRUNCATE; action <= Logger::ACTION_ROTATE; action++)
+    {
+        Logger::destroy(testFile);
+        remove(testFile.c_str());
+        customLogger = Logger::getFileLogger(testFile, static_cast<Logger::OverflowAction>(action));
+        customLogger->setMaxLogSize(1024);
+        
+        LogReader follower(testFile, true);
+        std::vector<std::string> messages;
+        const int numberOfRecords = 100;
+        for(int i=0; i < numberOfRecords; i++)
+        {
+            customLogger->operator()(Logger::LOG_LEVEL_NORMAL) << i << longString;
+            //Poll every few records so that some of them are read from the old file
+            if(i % 3 == 0)
+            {
+                records.clear();
+                follower.poll(records);
+                for(size_t r=0; r < records.size(); r++) messages.push_back(records[r].getMessage());
+            }
+        }
+        records.clear();
+        follower.poll(records);
+        for(size_t r=0; r < records.size(); r++) messages.push_back(records[r].getMessage());
+        
+        assert(messages.size() == numberOfRecords);
+        for(int i=0; i < numberOfRecords; i++) {
+            assert(messages[i] == std::to_string(i) + longString);
+        }
+    }
+    
+    DIR* pDir = opendir(".");
+    assert(pDir);
+    while(dirent* pEntry = readdir(pDir))
+    {
+        const std::string name = pEntry->d_name;
+        if(name.compare(0, testFile.size() + 1, testFile + "_") == 0) remove(name.c_str());
+    }
+    closedir(pDir);
+#endif
+    
+    Logger::destroy(testFile);
+    remove(testFile.c_str());
+}
+
+std::string makeScannerRecord(size_t i)
+{
+    static const char* levels[] = { "ERR", "WRN", "   ", "DBG" };
+    char header[64];
+    snprintf(header, sizeof(header), "[2019-02-08-10-%02u-%02u-%03u] %016x %s| ", unsigned(i / 60000 % 60), unsigned(i / 1000 % 60), unsigned(i % 1000), unsigned(i % 3 == 0 ? 0xabc : 0xdef), levels[i % 4]);
+    std::string record = header + std::string("message ") + std::to_string(i) + (i % 7 == 0 ? " needle" : "") + std::string(i % 50, 'x');
+    //Continuation line of a multi-line message, without a header
+    if(i % 1000 == 0) record += "\ncontinued needle";
+    return record;
+}
+
+void TEST_logScanner()
+{
+    const std::string testFile = "TEST_logScanner.log";
+    std::string buffer;
+    for(size_t i=0; i < 120000; i++) {
+        buffer += makeScannerRecord(i) + "\n";
+    }
+    
+    LogScanner::Filter filters[4];
+    filters[0].substring = "needle";
+    filters[1].levels = LogScanner::LEVEL_ERROR;
+    filters[2].levels = LogScanner::LEVEL_WARNING | LogScanner::LEVEL_DEBUG;
+    filters[2].threadId = "0000000000000abc";
+    filters[2].fromTime = "2019-02-08-10-00-30";
+    filters[2].toTime = "2019-02-08-10-01-10";
+    filters[3].substring = "needle";
+    filters[3].levels = LogScanner::LEVEL_ALL;
+    
+    //Expected matches from a plain line by line check
+    std::vector<std::vector<std::string> > expected(4);
+    std::istringstream lines(buffer);
+    std::string line;
+    while(std::getline(lines, line))
+    {
+        const bool header = line[0] == '[';
+        const std::string level = header ? line.substr(43, 3) : "";
+        const std::string time = header ? line.substr(1, 23) : "";
+        const std::string message = header ? line.substr(48) : line;
+        if(message.find("needle") != std::string::npos) expected[0].push_back(line);
+        if(level == "ERR") expected[1].push_back(line);
+        if((level == "WRN" || level == "DBG") && line.compare(26, 16, "0000000000000abc") == 0 && time >= "2019-02-08-10-00-30" && time.compare(0, 19, "2019-02-08-10-01-10") <= 0) expected[2].push_back(line);
+        if(message.find("needle") != std::string::npos) expected[3].push_back(line);
+    }
+    assert(expected[0].size() > 0 && expected[1].size() > 0 && expected[2].size() > 0);
+    
+    //Every kernel and thread count reports the same records in order
+    const LogScanner::Kernel kernels[] = { LogScanner::KERNEL_SCALAR, LogScanner::KERNEL_SSE2, LogScanner::KERNEL_AVX2 };
+    for(int k=0; k < 3; k++)
+    {
+        if(!LogScanner::setKernel(kernels[k])) continue;
+        for(int f=0; f < 4; f++)
+        {
+            for(unsigned threads = 1; threads <= 4; threads += 3)
+            {
+                std::vector<std::string> found;
+                const size_t count = LogScanner::scanBuffer(buffer.data(), buffer.size(), filters[f], [&found](const char* data, size_t size) {
+                    found.push_back(std::string(data, size));
+                }, threads);
+                assert(count == found.size());
+                assert(found == expected[f]);
+            }
+        }
+    }
+    LogScanner::setKernel(LogScanner::KERNEL_AUTO);
+    
+    //Files written by the logger are scanned
+    auto customLogger = Logger::getFileLogger(testFile, Logger::ACTION_NONE);
+    customLogger->operator()(Logger::LOG_LEVEL_ERROR) << "first needle";
+    customLogger->operator()(Logger::LOG_LEVEL_WARNING) << "second needle";
+    customLogger->operator()(Logger::LOG_LEVEL_ERROR) << "third";
+    size_t matchCount = 0;
+    std::vector<std::string> found;
+    LogScanner::Filter filter;
+    filter.levels = LogScanner::LEVEL_ERROR;
+    filter.substring = "needle";
+    assert(LogScanner::scanFile(testFile, filter, [&found](const char* data, size_t size) { found.push_back(std::string(data, size)); }, matchCount) == Logger::RES_OK);
+    assert(matchCount == 1 && found.size() == 1 && found[0].substr(48) == "first needle");
+    
+    filter.threadId = "abc";
+    assert(LogScanner::scanFile(testFile, filter, [](const char*, size_t) {}, matchCount) == Logger::RES_BAD_ARGS);
+    
+    Logger::destroy(testFile);
+    remove(testFile.c_str());
+}
+
+int logFromCallSites(const std::string& testFile, const std::string& message, int& quietLine)
+{
+    const int noisyLine = __LINE__; LOGF(Logger::LOG_LEVEL_NORMAL, testFile) << message;
+    quietLine = __LINE__; LOGF(Logger::LOG_LEVEL_NORMAL, testFile) << "short";
+    LOGF(Logger::LOG_LEVEL_DEBUG, testFile) << "filtered";
+    return noisyLine;
+}
+
+void TEST_callSites()
+{
+    const std::string testFile = "TEST_callSites.log";
+    const std::string longMessage(100, 'a');
+    auto customLogger = Logger::getFileLogger(testFile);
+    Logger::resetCallSiteCounters();
+    
+    int noisyLine = 0, quietLine = 0;
+    for(int i=0; i < 10; i++) {
+        noisyLine = logFromCallSites(testFile, longMessage, quietLine);
+    }
+    
+    //Top site by volume comes first, filtered records are not counted
+    std::vector<Logger::CallSiteStats> sites = Logger::getTopCallSites(2);
+    assert(sites.size() == 2);
+    assert(sites[0].line == noisyLine && sites[0].hits == 10 && sites[0].bytes == 10 * longMessage.size());
+    assert(sites[1].line == quietLine && sites[1].hits == 10 && sites[1].bytes == 50);
+    assert(sites[0].level == "Logger::LOG_LEVEL_NORMAL" && sites[0].logger == "testFile");
+    
+    //A disabled site is dropped, the others are not affected
+    assert(Logger::setCallSiteEnabled("main.cpp", noisyLine, false) == 1);
+    assert(Logger::setCallSiteEnabled("ain.cpp", quietLine, false) == 0);
+    const size_t size = getFileSize(testFile);
+    const size_t overhead = (size - 10 * (longMessage.size() + 5)) / 20; //Header and new line of a record
+    for(int i=0; i < 10; i++) {
+        logFromCallSites(testFile, longMessage, quietLine);
+    }
+    assert(getFileSize(testFile) == size + 10 * (5 + overhead));
+    assert(Logger::getTopCallSites(1)[0].hits == 10);
+    
+    //Sites which have not run yet take the setting when they register
+    const int futureLine = __LINE__ + 2;
+    Logger::setCallSiteEnabled("main.cpp", futureLine, false);
+    LOGF(Logger::LOG_LEVEL_ERROR, testFile) << "never logged";
+    assert(getLastLogMessage(testFile) == "short");
+    
+    std::ostringstream dump;
+    Logger::dumpTopCallSites(dump, 0);
+    assert(dump.str().find("main.cpp:" + std::to_string(futureLine)) != std::string::npos);
+    
+    //Repeating a setting makes it override the rules which were added after its first call
+    const int laterLine = __LINE__ + 4;
+    Logger::setCallSiteEnabled("main.cpp", laterLine, false);
+    Logger::setCallSiteEnabled("main.cpp", 0, true);
+    Logger::setCallSiteEnabled("main.cpp", laterLine, false);
+    LOGF(Logger::LOG_LEVEL_ERROR, testFile) << "never logged";
+    assert(getLastLogMessage(testFile) == "short");
+    
+    //A site registering while a setting is made is either listed for it or takes it from the rules, sites are never removed
+    const int raceSiteCount = 2000;
+    std::vector<Logger::CallSite*> raceSites(raceSiteCount);
+    std::atomic<int> registered(0);
+    std::thread registrar([&raceSites, &registered]() {
+        for(int i=0; i < raceSiteCount; i++)
+        {
+            raceSites[i] = new Logger::CallSite("race/site.cpp", i + 1, "Logger::LOG_LEVEL_NORMAL", "testFile");
+            registered.store(i + 1);
+        }
+    });
+    while(registered.load() < raceSiteCount / 2) {
+        std::this_thread::yield();
+    }
+    Logger::setCallSiteEnabled("site.cpp", 0, false);
+    registrar.join();
+    for(int i=0; i < raceSiteCount; i++) {
+        assert(!raceSites[i]->enabled.load());
+    }
+    
+    Logger::setCallSiteEnabled("main.cpp", 0, true);
+    Logger::destroy(testFile);
+    remove(testFile.c_str());
+}
+
+//Single threaded scheduler like the event loop of a coroutine executor, runs posted tasks when the owner calls runOne
+class TestScheduler
+{
+public:
+    void post(std::function<void()> task)
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_tasks.push_back(std::move(task));
+        m_cond.notify_one();
+    }
+    
+    bool runOne(unsigned timeoutMs)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lk(m_mutex);
+            if(!m_cond.wait_for(lk, std::chrono::milliseconds(timeoutMs), [this]() { return !m_tasks.empty(); })) {
+                return false;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+        return true;
+    }
+    
+    Logger::Executor executor()
+    {
+        return [this](std::function<void()> task) { post(std::move(task)); };
+    }
+    
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()> > m_tasks;
+};
+
+void TEST_asyncLogging()
+{
+    const std::string testFile = "TEST_asyncLogging.log";
+    const int recordCount = 100;
+    auto customLogger = Logger::getFileLogger(testFile, Logger::ACTION_NONE);
+    TestScheduler scheduler;
+    
+    //Fire-and-forget statements are written by the I/O thread in order, a flush completes after them on the scheduler
+    customLogger->setAsyncLogging(true);
+    for(int i=0; i < recordCount; i++) {
+        LOGF(Logger::LOG_LEVEL_NORMAL, testFile) << "record " << i;
+    }
+    LOGF(Logger::LOG_LEVEL_DEBUG, testFile) << "filtered";
+    
+    bool flushed = false;
+    Logger::Result flushResult = Logger::RES_ERROR;
+    std::thread::id completionThread;
+    customLogger->flushAsync([&](Logger::Result res) {
+        flushed = true;
+        flushResult = res;
+        completionThread = std::this_thread::get_id();
+    }, scheduler.executor());
+    assert(!flushed);
+    while(!flushed) {
+        assert(scheduler.runOne(5000));
+    }
+    assert(flushResult == Logger::RES_OK && completionThread == std::this_thread::get_id());
+    
+    LogReader reader(testFile, true);
+    std::vector<LogReader::Record> records;
+    assert(reader.poll(records) == static_cast<size_t>(recordCount));
+    for(int i=0; i < recordCount; i++) {
+        assert(records[i].getMessage() == "record " + std::to_string(i));
+    }
+    
+    //Durable write
+    bool written = false;
+    customLogger->writeAsync(Logger::LOG_LEVEL_WARNING, "durable", [&written](Logger::Result res) { written = res == Logger::RES_OK; }, scheduler.executor());
+    while(!written) {
+        assert(scheduler.runOne(5000));
+    }
+    assert(getLastLogMessage(testFile) == "durable");
+    
+    //Records are dropped instead of waiting when the queue is full
+    customLogger->setAsyncQueueCapacity(0);
+    assert(!customLogger->post(Logger::LOG_LEVEL_ERROR, "dropped"));
+    LOGF(Logger::LOG_LEVEL_ERROR, testFile) << "dropped";
+    assert(customLogger->getAsyncDroppedCount() == 2);
+    customLogger->setAsyncQueueCapacity(8192);
+    assert(customLogger->post(Logger::LOG_LEVEL_ERROR, "posted"));
+    
+    customLogger->setAsyncLogging(false);
+    Logger::destroy(testFile);
+    customLogger.reset(); //Drains the queue
+    assert(getLastLogMessage(testFile) == "posted");
+    
+    //A completion on the I/O thread may drop the last reference, the requests queued behind it are done by the destructor
+    customLogger = Logger::getFileLogger(testFile, Logger::ACTION_NONE);
+    std::atomic<bool> started(false), released(false), destroyed(false);
+    Logger::LogPtr* pLast = new Logger::LogPtr(customLogger);
+    customLogger->flushAsync([pLast, &started, &released, &destroyed](Logger::Result) {
+        started = true;
+        while(!released) {
+            std::this_thread::yield();
+        }
+        delete pLast;
+        destroyed = true;
+    });
+    while(!started) {
+        std::this_thread::yield();
+    }
+    assert(customLogger->post(Logger::LOG_LEVEL_ERROR, "drained"));
+    Logger::destroy(testFile);
+    customLogger.reset();
+    released = true;
+    while(!destroyed) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(getLastLogMessage(testFile) == "drained");
+    
+    //A logger reclaimed by the manager is destroyed after the manager is unlocked, its pending completions may call the manager
+    customLogger = Logger::getFileLogger(testFile, Logger::ACTION_NONE);
+    std::atomic<bool> completing(false), reclaimed(false);
+    std::atomic<size_t> loggerCount(0);
+    customLogger->flushAsync([&completing, &loggerCount](Logger::Result) {
+        completing = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        loggerCount = Logger::getLoggerCount();
+    });
+    while(!completing) {
+        std::this_thread::yield();
+    }
+    customLogger.reset();
+    std::thread reclaimer([&reclaimed]() {
+        assert(Logger::reclaimIdleLoggers() >= 1);
+        reclaimed = true;
+    });
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(!reclaimed && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(reclaimed && loggerCount > 0);
+    reclaimer.join();
+    remove(testFile.c_str());
+}
+
+void TEST_loadGovernor()
+{
+    const std::string testFile = "TEST_loadGovernor.log";
+    const std::string message(100, 'a');
+    auto customLogger = Logger::getFileLogger(testFile, Logger::ACTION_NONE);
+    customLogger->setLogLevel(Logger::LOG_LEVEL_DEBUG);
+    
+    Logger::GovernorConfig config;
+    assert(customLogger->setGovernor(config) == Logger::RES_BAD_ARGS);
+    config.maxBytesPerSecond = 20000;
+    config.windowMs = 20;
+    config.sampleInterval = 1;
+    config.restoreWindows = 2;
+    assert(customLogger->setGovernor(config) == Logger::RES_OK);
+    
+    //A burst sheds DEBUG, then NORMAL records, warnings are kept
+    for(int i=0; i < 1000 && customLogger->getGovernorStats().sheds < 2; i++)
+    {
+        for(int j=0; j < 10; j++)
+        {
+            customLogger->operator()(Logger::LOG_LEVEL_DEBUG) << message;
+            customLogger->operator()(Logger::LOG_LEVEL_NORMAL) << message;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    Logger::GovernorStats stats = customLogger->getGovernorStats();
+    assert(stats.sheds == 2 && stats.level == Logger::LOG_LEVEL_WARNING);
+    assert(getLastLogMessage(testFile).compare(0, 33, "Load governor sheds NORMAL record") == 0);
+    assert(!customLogger->isLogged(Logger::LOG_LEVEL_NORMAL) && customLogger->isLogged(Logger::LOG_LEVEL_WARNING));
+    
+    const size_t size = getFileSize(testFile);
+    customLogger->operator()(Logger::LOG_LEVEL_NORMAL) << "shed";
+    assert(getFileSize(testFile) == size);
+    customLogger->operator()(Logger::LOG_LEVEL_WARNING) << "kept";
+    assert(getLastLogMessage(testFile) == "kept");
+    
+    //Levels are restored one by one once the load, shed statements included, falls under half of the budget
+    for(int i=0; i < 500 && customLogger->getGovernorStats().restores < 2; i++)
+    {
+        customLogger->operator()(Logger::LOG_LEVEL_DEBUG) << message;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    stats = customLogger->getGovernorStats();
+    assert(stats.restores == 2 && stats.level == Logger::LOG_LEVEL_INSANE && stats.shedRecords > 0);
+    
+    customLogger->removeGovernor();
+    Logger::destroy(testFile);
+    remove(testFile.c_str());
+}
+
+void TEST_faultInjection()
+{
+    const std::string testFile = "TEST_faultInjection.log";
+    auto customLogger = Logger::getFileLogger(testFile, Logger::ACTION_NONE);
+    
+    //Second write fails with ENOSPC after half of the record, fourth write is short
+    std::atomic<int> writeCount(0);
+    Logger::setWriteHook([&writeCount, &testFile](const std::string& path, size_t size, Logger::WriteFault& fault) {
+        if(path != testFile) return;
+        const int n = ++writeCount;
+        if(n == 2 || n == 4) fault.size = size / 2;
+        if(n == 2) fault.error = ENOSPC;
+    });
+    for(int i=0; i < 6; i++) {
+        customLogger->operator()(Logger::LOG_LEVEL_NORMAL) << "record " << i;
+    }
+    Logger::setWriteHook(Logger::WriteHook());
+    
+    //The failed record is cut and lost, the short one is completed, the logger continues after the error
+    assert(writeCount == 7 && customLogger->getWriteErrorCount() == 1);
+    std::ifstream inFile(testFile.c_str());
+    std::vector<std::string> lines;
+    std::string line;
+    while(std::getline(inFile, line)) {
+        lines.push_back(line);
+    }
+    assert(lines.size() == 6);
+    assert(lines[0].substr(48) == "record 0" && lines[1].size() < 48 + 8 && lines[1][0] == '[');
+    for(int i=2; i < 6; i++) {
+        assert(lines[i].substr(48) == "record " + std::to_string(i));
+    }
+    
+    Logger::destroy(testFile);
+    remove(testFile.c_str());
+}
+
+#ifndef _MSC_VER
+//Removes the rotated files of a log file and returns their names
+std::vector<std::string> removeRotatedFiles(const std::string& filePath, bool keep = false)
+{
+    std::vector<std::string> names;
+    DIR* pDir = opendir(".");
+    assert(pDir);
+    while(dirent* pEntry = readdir(pDir))
+    {
+        const std::string name = pEntry->d_name;
+        if(name.compare(0, filePath.size() + 1, filePath + "_") != 0) continue;
+        names.push_back(name);
+        if(!keep) remove(name.c_str());
+    }
+    closedir(pDir);
+    return names;
+}
+
+void TEST_asyncRotation()
+{
+    const std::string testFile = "TEST_asyncRotation";
+    const std::string nextFile = testFile + ".next";
+    const int recordCount = 200;
+    auto customLogger = Logger::getFileLogger(testFile, Logger::ACTION_ROTATE);
+    customLogger->setMaxLogSize(2048);
+    customLogger->setAsyncRotation(true, true);
+    
+    //The next file is prepared before the first rotation
+    for(int i=0; i < 500 && !std::ifstream(nextFile.c_str()).is_open(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    assert(std::ifstream(nextFile.c_str()).is_open());
+    
+    for(int i=0; i < recordCount; i++) {
+        customLogger->operator()(Logger::LOG_LEVEL_NORMAL) << std::setw(4) << std::setfill('0') << i << std::string(100, 'a');
+    }
+    
+    //Stopping the rotation thread closes the rotated files and removes the prepared one
+    customLogger->setAsyncRotation(false);
+    assert(!std::ifstream(nextFile.c_str()).is_open());
+    
+    //Every record is in exactly one file, none of the files exceeds the maximum size by more than a record
+    std::vector<std::string> files = removeRotatedFiles(testFile, true);
+    assert(files.size() > 1);
+    files.push_back(testFile);
+    std::vector<int> seen(recordCount, 0);
+    for(size_t i=0; i < files.size(); i++)
+    {
+        assert(getFileSize(files[i]) <= 2048 + 200);
+        std::ifstream inFile(files[i].c_str());
+        std::string line;
+        while(std::getline(inFile, line)) {
+            seen[std::stoi(line.substr(48, 4))]++;
+        }
+        remove(files[i].c_str());
+    }
+    for(int i=0; i < recordCount; i++) {
+        assert(seen[i] == 1);
+    }
+    
+    Logger::destroy(testFile);
+}
+#endif
+
 void TEST_truncation()
 {
     const std::string testFile = "TEST_truncation";
@@ -267,7 +1388,7 @@ void TEST_multithreadedMultipleThreadsSingleFile()
 {
     const std::string testFile = "TEST_multithreadedMultipleThreadsSingleFile";
     auto customLogger = Logger::getFileLogger(testFile, Logger::ACTION_NONE);
-
+    
     // Create multiple writers to the same logger
     const int threadCnt = 8;
     std::thread* threads[threadCnt];
@@ -292,17 +1413,387 @@ void TEST_multithreadedMultipleThreadsSingleFile()
     remove(testFile.c_str());
 }
 
+template<typename T>
+double benchmarkInsertion(std::ostringstream& stream, T value, size_t count)
+{
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i=0; i < count; i++) {
+        stream << value;
+        if((i & 1023) == 1023) stream.str("");
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+template<typename T>
+double benchmarkInsertion(Logger::LogPtr logger, T value, size_t count)
+{
+    auto&& stream = logger->operator()(Logger::LOG_LEVEL_NORMAL);
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i=0; i < count; i++) {
+        stream << value;
+        if((i & 1023) == 1023) stream.str("");
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+void BENCH_numberFormatting()
+{
+    const std::string benchFile = "BENCH_numberFormatting.log";
+    const size_t count = 2000000;
+    auto customLogger = Logger::getFileLogger(benchFile, Logger::ACTION_NONE); //Each measurement writes a single record when its stream is destroyed
+    
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Number formatting (ns per insertion)      ostringstream   logstream" << std::endl;
+    {
+        std::ostringstream ss;
+        std::cout << "  int                                      " << std::setw(13) << benchmarkInsertion(ss, -123456789, count) << std::setw(12) << benchmarkInsertion(customLogger, -123456789, count) << std::endl;
+    }
+    {
+        std::ostringstream ss;
+        std::cout << "  unsigned long long                       " << std::setw(13) << benchmarkInsertion(ss, 18446744073709551615ull, count) << std::setw(12) << benchmarkInsertion(customLogger, 18446744073709551615ull, count) << std::endl;
+    }
+    {
+        std::ostringstream ss;
+        std::cout << "  double (FLOAT_FORMAT_STREAM)             " << std::setw(13) << benchmarkInsertion(ss, 3.141592653589793, count) << std::setw(12) << benchmarkInsertion(customLogger, 3.141592653589793, count) << std::endl;
+    }
+    customLogger->setFloatFormat(Logger::FLOAT_FORMAT_SHORTEST);
+    {
+        std::ostringstream ss;
+        ss << std::setprecision(17);
+        std::cout << "  double (FLOAT_FORMAT_SHORTEST vs %.17g)  " << std::setw(13) << benchmarkInsertion(ss, 3.141592653589793, count) << std::setw(12) << benchmarkInsertion(customLogger, 3.141592653589793, count) << std::endl;
+    }
+    {
+        std::ostringstream ss;
+        ss << std::setprecision(9);
+        std::cout << "  float (FLOAT_FORMAT_SHORTEST vs %.9g)    " << std::setw(13) << benchmarkInsertion(ss, 0.3f, count) << std::setw(12) << benchmarkInsertion(customLogger, 0.3f, count) << std::endl;
+    }
+    
+    Logger::destroy(benchFile);
+    remove(benchFile.c_str());
+}
+
+void BENCH_logScanner()
+{
+    std::string buffer;
+    for(size_t i=0; buffer.size() < 256*1024*1024; i++) {
+        buffer += makeScannerRecord(i) + "\n";
+    }
+    LogScanner::Filter filter;
+    filter.levels = LogScanner::LEVEL_ERROR;
+    filter.substring = "needle 7";
+    
+    //Getline loop as the baseline
+    auto start = std::chrono::steady_clock::now();
+    std::istringstream lines(buffer);
+    std::string line;
+    size_t lineMatches = 0;
+    while(std::getline(lines, line)) {
+        if(line.size() > 48 && line.compare(43, 3, "ERR") == 0 && line.find("needle 7", 48) != std::string::npos) lineMatches++;
+    }
+    const double getlineSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Scanning " << buffer.size() / (1024*1024) << " MB (GB/s)  getline: " << buffer.size() / getlineSeconds / 1e9;
+    
+    const LogScanner::Kernel kernels[] = { LogScanner::KERNEL_SCALAR, LogScanner::KERNEL_SSE2, LogScanner::KERNEL_AVX2 };
+    for(int k=0; k < 3; k++)
+    {
+        if(!LogScanner::setKernel(kernels[k])) continue;
+        for(unsigned threads = 1; threads <= std::max(1u, std::thread::hardware_concurrency()); threads *= 4)
+        {
+            start = std::chrono::steady_clock::now();
+            const size_t matches = LogScanner::scanBuffer(buffer.data(), buffer.size(), filter, [](const char*, size_t) {}, threads);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            assert(matches == lineMatches);
+            std::cout << "  " << LogScanner::getKernelName(kernels[k]) << " x" << threads << ": " << buffer.size() / seconds / 1e9;
+        }
+    }
+    LogScanner::setKernel(LogScanner::KERNEL_AUTO);
+    std::cout << std::endl;
+}
+
+#ifndef _MSC_VER
+void BENCH_rotation()
+{
+    const std::string benchFile = "BENCH_rotation";
+    const std::string message(100, 'a');
+    const size_t maxSize = 1024*1024;
+    const int count = 200000;
+    const char* modes[] = { "synchronous", "async", "async+fsync" };
+    
+    for(int mode=0; mode < 3; mode++)
+    {
+        auto logger = Logger::getFileLogger(benchFile, Logger::ACTION_ROTATE);
+        logger->setMaxLogSize(maxSize);
+        logger->setAsyncRotation(mode > 0, mode == 2);
+        logger->operator()(Logger::LOG_LEVEL_NORMAL) << message;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        
+        //Records have the same size, the record written when the file exceeds the maximum size rotates it
+        const size_t recordsPerFile = maxSize / getFileSize(benchFile) + 1;
+        std::vector<double> rotating, others;
+        for(int i=1; i < count; i++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            logger->operator()(Logger::LOG_LEVEL_NORMAL) << message;
+            const double latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            if(i % recordsPerFile == 0) rotating.push_back(latency);
+            else others.push_back(latency);
+        }
+        Logger::destroy(benchFile);
+        logger.reset();
+        const size_t rotations = removeRotatedFiles(benchFile).size();
+        remove(benchFile.c_str());
+        assert(rotations == rotating.size());
+        
+        std::sort(rotating.begin(), rotating.end());
+        std::sort(others.begin(), others.end());
+        double rotatingSum = 0;
+        for(size_t i=0; i < rotating.size(); i++) {
+            rotatingSum += rotating[i];
+        }
+        std::cout << "Rotation " << std::setw(11) << modes[mode] << " (us)  rotating record mean: " << rotatingSum / rotating.size() << " max: " << rotating.back()
+                  << "  other records p50: " << others[others.size() / 2] << " p99.9: " << others[others.size() - others.size() / 1000] << std::endl;
+    }
+}
+
+//Faults injected into the writes of a log file by the fault injection harness
+struct FaultProfile
+{
+    const char*     name;
+    unsigned        latencyUs;          ///< Added to every write
+    unsigned        stallEvery;         ///< Every Nth write stalls for stallMs
+    unsigned        stallMs;
+    unsigned        failEvery;          ///< Every Nth write accepts half of the buffer and fails with ENOSPC
+    unsigned        shortEvery;         ///< Every Nth write accepts half of the buffer, the logger writes the rest
+};
+
+struct FaultCounters
+{
+    std::atomic<unsigned long long> writes;
+    std::atomic<unsigned long long> failures;
+    std::atomic<unsigned long long> shortWrites;
+};
+
+void faultWriterThread(Logger::LogPtr logger, int threadId, int recordCount, size_t recordSize, std::vector<double>* pLatencies)
+{
+    char prefix[32];
+    for(int i=0; i < recordCount; i++)
+    {
+        snprintf(prefix, sizeof(prefix), "T%02d R%06d ", threadId, i);
+        const std::string message = prefix + std::string(recordSize - strlen(prefix), 'x');
+        const auto start = std::chrono::steady_clock::now();
+        logger->operator()(Logger::LOG_LEVEL_NORMAL) << message;
+        pLatencies->push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+}
+
+/**
+ * @brief    Runs a multi-threaded workload on a degraded disk for each overflow action and fault profile, with a file logger and a shared file logger.
+ *           Reports the caller latency percentiles, checks that every record is written once and complete, or lost by a failed write, and that no line
+ *           mixes two records. With truncation only the records written after the last truncation point are checked for losses.
+ * @return   false if a check fails.
+ */
+bool BENCH_faultInjection()
+{
+    const std::string benchFile = "BENCH_faultInjection";
+    const int threadCount = 4;
+    const int recordCount = 2000;
+    const size_t messageSize = 100;
+    const size_t lineSize = 48 + messageSize;
+    const FaultProfile profiles[] = {
+        { "healthy",        0,      0,      0,      0,      0 },
+        { "slow disk",      200,    0,      0,      0,      0 },
+        { "stalls",         0,      1000,   50,     0,      0 },
+        { "ENOSPC",         0,      0,      0,      97,     0 },
+        { "short writes",   0,      0,      0,      0,      13 }
+    };
+    const Logger::OverflowAction actions[] = { Logger::ACTION_NONE, Logger::ACTION_TRUNCATE, Logger::ACTION_ROTATE };
+    const char* actionNames[] = { "none", "truncate", "rotate" };
+    bool passed = true;
+    
+    for(int shared=0; shared < 2; shared++)
+    {
+        for(int a=0; a < 3; a++)
+        {
+            for(size_t f=0; f < sizeof(profiles) / sizeof(profiles[0]); f++)
+            {
+                const FaultProfile& profile = profiles[f];
+                FaultCounters counters;
+                counters.writes = 0;
+                counters.failures = 0;
+                counters.shortWrites = 0;
+                Logger::setWriteHook([&profile, &counters, &benchFile](const std::string& path, size_t size, Logger::WriteFault& fault) {
+                    if(path != benchFile) return;
+                    const unsigned long long n = ++counters.writes;
+                    fault.delayUs = profile.latencyUs;
+                    if(profile.stallEvery && n % profile.stallEvery == 0) fault.delayUs += profile.stallMs * 1000;
+                    if(profile.failEvery && n % profile.failEvery == 0)
+                    {
+                        fault.size = size / 2;
+                        fault.error = ENOSPC;
+                        counters.failures++;
+                    }
+                    else if(profile.shortEvery && n % profile.shortEvery == 0)
+                    {
+                        fault.size = size / 2;
+                        counters.shortWrites++;
+                    }
+                });
+                
+                auto logger = shared ? Logger::getSharedFileLogger(benchFile, actions[a]) : Logger::getFileLogger(benchFile, actions[a]);
+                logger->setMaxLogSize(256 * 1024);
+                std::vector<double> latencies[threadCount];
+                std::vector<std::thread> threads;
+                for(int t=0; t < threadCount; t++) {
+                    threads.push_back(std::thread(faultWriterThread, logger, t, recordCount, messageSize, &latencies[t]));
+                }
+                for(int t=0; t < threadCount; t++) {
+                    threads[t].join();
+                }
+                const unsigned long long writeErrors = logger->getWriteErrorCount();
+                Logger::setWriteHook(Logger::WriteHook());
+                Logger::destroy(benchFile);
+                logger.reset();
+                
+                //Complete records are counted once, cut records are counted as torn lines, anything else is corruption
+                std::vector<std::string> files = removeRotatedFiles(benchFile, true);
+                files.push_back(benchFile);
+                remove((benchFile + ".ctl").c_str());
+                std::vector<int> seen(threadCount * recordCount, 0);
+                size_t complete = 0, torn = 0, cutByTruncation = 0, corrupt = 0, duplicates = 0;
+                for(size_t i=0; i < files.size(); i++)
+                {
+                    std::ifstream inFile(files[i].c_str());
+                    std::string line;
+                    bool firstLine = true;
+                    while(std::getline(inFile, line))
+                    {
+                        int threadId = -1, recordId = -1;
+                        const bool valid = line.size() == lineSize && line[0] == '[' && line[46] == '|' && sscanf(line.c_str() + 48, "T%d R%d ", &threadId, &recordId) == 2 &&
+                                           threadId >= 0 && threadId < threadCount && recordId >= 0 && recordId < recordCount;
+                        if(valid)
+                        {
+                            if(seen[threadId * recordCount + recordId]++ > 0) duplicates++;
+                            else complete++;
+                        }
+                        else if(line.empty()) {}
+                        else if(line.size() < lineSize && line[0] == '[') torn++;
+                        else if(firstLine && actions[a] == Logger::ACTION_TRUNCATE) cutByTruncation++;
+                        else corrupt++;
+                        firstLine = false;
+                    }
+                    remove(files[i].c_str());
+                }
+                
+                //A thread writes its records in order, so its records after the first one kept by the last truncation can only be lost by failed writes
+                size_t lost = 0;
+                for(int t=0; t < threadCount; t++)
+                {
+                    int first = 0;
+                    if(actions[a] == Logger::ACTION_TRUNCATE) {
+                        while(first < recordCount && !seen[t * recordCount + first]) first++;
+                    }
+                    for(int r=first; r < recordCount; r++) {
+                        if(!seen[t * recordCount + r]) lost++;
+                    }
+                }
+                const bool ok = corrupt == 0 && duplicates == 0 && writeErrors == counters.failures && torn <= counters.failures &&
+                                (actions[a] == Logger::ACTION_TRUNCATE ? lost <= torn : lost == counters.failures);
+                passed = passed && ok;
+                
+                std::vector<double> all;
+                for(int t=0; t < threadCount; t++) {
+                    all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+                }
+                std::sort(all.begin(), all.end());
+                std::cout << (shared ? "shared " : "  file ") << std::setw(8) << actionNames[a] << std::setw(13) << profile.name << " (us)  p50: " << std::setw(7) << all[all.size() / 2]
+                          << "  p99: " << std::setw(7) << all[all.size() * 99 / 100] << "  p99.9: " << std::setw(7) << all[all.size() * 999 / 1000]
+                          << "  max: " << std::setw(7) << all.back() << "  | failed writes: " << writeErrors << "  short writes: " << counters.shortWrites
+                          << "  lost: " << lost << "  torn: " << torn << "  corrupt: " << corrupt << "  duplicates: " << duplicates
+                          << (cutByTruncation ? "  cut by truncation: " + std::to_string(cutByTruncation) : std::string()) << (ok ? "  OK" : "  FAILED") << std::endl;
+            }
+        }
+    }
+    return passed;
+}
+
+void BENCH_ringLogger()
+{
+    const std::string benchFile = "BENCH_ringLogger.log";
+    const std::string message(100, 'a');
+    const int count = 50000;
+    
+    auto fileLogger = Logger::getFileLogger(benchFile, Logger::ACTION_NONE);
+    auto start = std::chrono::steady_clock::now();
+    for(int i=0; i < count; i++) {
+        fileLogger->operator()(Logger::LOG_LEVEL_NORMAL) << message;
+    }
+    const double fileNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    Logger::destroy(benchFile);
+    remove(benchFile.c_str());
+    
+    //No daemon is running, the ring is large enough to hold every record
+    auto ringLogger = Logger::getRingLogger(benchFile, count);
+    start = std::chrono::steady_clock::now();
+    for(int i=0; i < count; i++) {
+        ringLogger->operator()(Logger::LOG_LEVEL_NORMAL) << message;
+    }
+    const double ringNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    Logger::destroy(benchFile);
+    remove((benchFile + ".ring").c_str());
+    
+    std::cout << "Logging a 100 byte message (ns per record)  file logger: " << fileNs << "  ring logger: " << ringNs << std::endl;
+}
+#endif
+
 int main(int argc, const char * argv[]) {
     
+#ifndef _MSC_VER
+    if(argc > 1 && std::string(argv[1]) == "--faults")
+    {
+        TEST_init();
+        return BENCH_faultInjection() ? 0 : 1;
+    }
+#endif
+    
+    if(argc > 1 && std::string(argv[1]) == "--bench")
+    {
+        TEST_init();
+        BENCH_numberFormatting();
+        BENCH_logScanner();
+#ifndef _MSC_VER
+        BENCH_rotation();
+        BENCH_ringLogger();
+#endif
+        return 0;
+    }
+    
     TEST_init();
     TEST_getAndDestroyLoggers();
     TEST_enableDisable();
     TEST_logLevel();
+    TEST_numberFormatting();
+    TEST_categoryLevels();
+    TEST_basicLogger();
+    TEST_fileCache();
+    TEST_logReader();
+    TEST_logScanner();
+    TEST_callSites();
+    TEST_asyncLogging();
+    TEST_loadGovernor();
+    TEST_faultInjection();
     TEST_truncation();
     //TEST_rotate(); --> Creates multiple files, disabled for now.
     TEST_multithreadedCreationAndDestruction();
     TEST_multithreadedDestructionWhileInUse();
     TEST_multithreadedMultipleThreadsSingleFile();
+#ifndef _MSC_VER
+    TEST_multiProcessSharedFile();
+    TEST_ringTransport();
+    TEST_ringRecovery();
+    TEST_asyncRotation();
+#endif
     
     std::cout << "Tests are completed without an error!" << std::endl;
     
@@ -0,0 +1,65 @@
+//
+//  rwloggerd.cpp
+//  rwlogger
+//
+//  Logging daemon for ring loggers (Logger::getRingLogger). It maps the ring of a log file
+//  and does the file writes, truncations and rotations on behalf of the logging processes.
+//
+//  Usage: rwloggerd <log file> [none|truncate|rotate] [max log size in bytes]
+//
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <csignal>
+#include "Logger.h"
+
+using namespace rw;
+
+static std::atomic<bool> s_stop(false);
+
+static void onSignal(int)
+{
+    s_stop = true;
+}
+
+int main(int argc, const char * argv[]) {
+    
+    if(argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <log file> [none|truncate|rotate] [max log size in bytes]" << std::endl;
+        return 1;
+    }
+    
+    const std::string filePath = argv[1];
+    Logger::OverflowAction overflowAction = Logger::ACTION_TRUNCATE;
+    if(argc > 2)
+    {
+        const std::string action = argv[2];
+        if(action == "none") overflowAction = Logger::ACTION_NONE;
+        else if(action == "truncate") overflowAction = Logger::ACTION_TRUNCATE;
+        else if(action == "rotate") overflowAction = Logger::ACTION_ROTATE;
+        else
+        {
+            std::cerr << "Unknown overflow action: " << action << std::endl;
+            return 1;
+        }
+    }
+    const size_t maxLogSize = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1024*1024;
+    
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    
+    const Logger::Result res = Logger::serveRing(filePath, overflowAction, maxLogSize, s_stop);
+    if(res == Logger::RES_ERROR)
+    {
+        std::cerr << "Another daemon is serving " << filePath << std::endl;
+        return 1;
+    }
+    if(res != Logger::RES_OK)
+    {
+        std::cerr << "Cannot map the ring of " << filePath << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+//
+//  rwscan.cpp
+//  rwlogger
+//
+//  Prints the records of rwlogger files which match a level, thread, substring and time window (see LogScanner).
+//
+//  Usage: rwscan [-l ERR,WRN,NRM,DBG] [-t thread id] [-s substring] [-f from time] [-u until time] [-j threads] [-k scalar|sse2|avx2] [-c] <log file>...
+//
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "LogScanner.h"
+
+using namespace rw;
+
+static void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [-l ERR,WRN,NRM,DBG] [-t thread id] [-s substring] [-f from time] [-u until time] [-j threads] [-k scalar|sse2|avx2] [-c] <log file>..." << std::endl;
+    std::cerr << "Times are compared with the record timestamps up to their length, e.g. -f 2019-02-08-10-30 -u 2019-02-08-11" << std::endl;
+}
+
+static bool parseLevels(const std::string& levels, unsigned& mask)
+{
+    mask = 0;
+    size_t start = 0;
+    while(start <= levels.size())
+    {
+        size_t end = levels.find(',', start);
+        if(end == std::string::npos) end = levels.size();
+        const std::string level = levels.substr(start, end - start);
+        if(level == "ERR") mask |= LogScanner::LEVEL_ERROR;
+        else if(level == "WRN") mask |= LogScanner::LEVEL_WARNING;
+        else if(level == "NRM") mask |= LogScanner::LEVEL_NORMAL;
+        else if(level == "DBG") mask |= LogScanner::LEVEL_DEBUG;
+        else return false;
+        start = end + 1;
+    }
+    return mask != 0;
+}
+
+int main(int argc, const char * argv[]) {
+    
+    LogScanner::Filter filter;
+    unsigned threadCount = 0;
+    bool countOnly = false;
+    std::vector<std::string> files;
+    
+    for(int i=1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if(arg == "-c") countOnly = true;
+        else if(arg == "-l" && hasValue)
+        {
+            if(!parseLevels(argv[++i], filter.levels))
+            {
+                std::cerr << "Unknown level in: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if(arg == "-t" && hasValue) filter.threadId = argv[++i];
+        else if(arg == "-s" && hasValue) filter.substring = argv[++i];
+        else if(arg == "-f" && hasValue) filter.fromTime = argv[++i];
+        else if(arg == "-u" && hasValue) filter.toTime = argv[++i];
+        else if(arg == "-j" && hasValue) threadCount = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if(arg == "-k" && hasValue)
+        {
+            const std::string kernel = argv[++i];
+            const LogScanner::Kernel selected = kernel == "scalar" ? LogScanner::KERNEL_SCALAR : kernel == "sse2" ? LogScanner::KERNEL_SSE2 : kernel == "avx2" ? LogScanner::KERNEL_AVX2 : LogScanner::KERNEL_AUTO;
+            if(selected == LogScanner::KERNEL_AUTO || !LogScanner::setKernel(selected))
+            {
+                std::cerr << "Kernel is not supported: " << kernel << std::endl;
+                return 1;
+            }
+        }
+        else if(!arg.empty() && arg[0] == '-')
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        else files.push_back(arg);
+    }
+    
+    if(files.empty())
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    //Records are written with fwrite, a large buffer keeps the output from limiting the scan
+    static char outputBuffer[1 << 20];
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+    
+    int exitCode = 1; //1 if nothing matches, like grep
+    for(size_t i=0; i < files.size(); i++)
+    {
+        size_t matchCount = 0;
+        const Logger::Result res = LogScanner::scanFile(files[i], filter, [countOnly](const char* data, size_t size) {
+            if(countOnly) return;
+            fwrite(data, 1, size, stdout);
+            fputc('\n', stdout);
+        }, matchCount, threadCount);
+        
+        if(res == Logger::RES_BAD_ARGS)
+        {
+            std::cerr << "Invalid filter, a thread id has 16 characters" << std::endl;
+            return 2;
+        }
+        if(res != Logger::RES_OK)
+        {
+            std::cerr << "Cannot read " << files[i] << std::endl;
+            exitCode = 2;
+            continue;
+        }
+        if(countOnly) {
+            printf("%s: %zu\n", files[i].c_str(), matchCount);
+        }
+        if(matchCount > 0 && exitCode == 1) {
+            exitCode = 0;
+        }
+    }
+    fflush(stdout);
+    return exitCode;
+}